@@ -0,0 +1,75 @@
+#include "asset.hpp"
+#include "base/command.hpp"
+#include "base/vector.hpp"
+
+namespace cube {
+namespace asset {
+
+// maximum number of requests finished per frame. it bounds the upload time
+VAR(assetuploads, 1, 4, 64);
+
+static vector<ref<request>> inflight; // submitted and not finished yet
+static vector<request*> loaded; // filled by the task threads
+static spinlock loadedlock;
+
+request::request(const char *name) :
+  task(name, 1, 1, 0, task::BG_PRIO), waited(false) {}
+
+void request::run(u32 elt) {
+  load();
+  loadedlock.lock();
+  loaded.add(this);
+  loadedlock.unlock();
+}
+
+void request::waitload(void) {
+  if (waited) return;
+  waited = true;
+  wait();
+}
+
+void submit(request *r) {
+  inflight.add(r);
+  r->scheduled();
+  if (tasking::threadnum() == 0) r->waitload();
+}
+
+static void finishloaded(s32 maxnum) {
+  loadedlock.lock();
+  const s32 n = min(loaded.size(), maxnum);
+  vector<request*> done;
+  loopi(n) done.add(loaded[i]);
+  loaded.erase(loaded.begin(), loaded.begin()+n);
+  loadedlock.unlock();
+
+  loopv(done) {
+    done[i]->finish();
+    loopvj(inflight) if (inflight[j] == done[i]) {
+      inflight[j] = inflight.back();
+      inflight.pop_back();
+      break;
+    }
+  }
+}
+
+void update(void) { finishloaded(assetuploads); }
+
+// finishing a request may submit new ones (model skins)
+void flush(void) {
+  while (inflight.size() != 0) {
+    loopv(inflight) inflight[i]->waitload();
+    finishloaded(inflight.size());
+  }
+}
+
+u32 pending(void) { return inflight.size(); }
+
+void clean(void) {
+  loopv(inflight) inflight[i]->waitload();
+  loaded.clear();
+  inflight.clear();
+}
+
+} // namespace asset
+} // namespace cube
+
@@ -0,0 +1,41 @@
+#pragma once
+#include "base/task.hpp"
+
+namespace cube {
+namespace asset {
+
+/*-------------------------------------------------------------------------
+ - asynchronous asset loading. files are read and decoded on the task
+ - threads. the main thread finishes the loaded requests once per frame
+ - (opengl uploads, sound registration...). until then, the renderer draws
+ - placeholders and sounds are skipped. requests run with the background
+ - priority so they never delay the frame
+ -------------------------------------------------------------------------*/
+struct request : public task {
+  request(const char *name);
+  // task thread: read and decode the file
+  virtual void load(void) = 0;
+  // main thread: hand the data to opengl or to the mixer
+  virtual void finish(void) = 0;
+  virtual void run(u32 elt);
+  // wait for load() to be done. unlike task::wait, it may be called several
+  // times. main thread only
+  void waitload(void);
+  bool waited;
+};
+
+// schedule the request. with no task thread, it is loaded right away. main
+// thread only
+void submit(request *r);
+// finish the requests loaded since the last call. main thread only
+void update(void);
+// wait for the pending requests and finish all of them. main thread only
+void flush(void);
+// number of requests still loading or waiting to be finished
+u32 pending(void);
+// wait for the pending requests and drop them unfinished
+void clean(void);
+
+} // namespace asset
+} // namespace cube
+
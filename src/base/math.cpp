@@ -106,5 +106,27 @@ camera::camera(vec3f org, vec3f up, vec3f view, float fov, float ratio) :
   xaxis *= ratio;
 }
 
+frustum::frustum(const mat4x4f &m) {
+  vec4f rows[4];
+  loopi(4) rows[i] = vec4f(m.vx[i], m.vy[i], m.vz[i], m.vw[i]);
+  loopi(3) {
+    planes[2*i+0] = rows[3]+rows[i];
+    planes[2*i+1] = rows[3]-rows[i];
+  }
+  loopi(6) planes[i] = planes[i]/length(planes[i].xyz());
+}
+
+// only test the box corners the farthest along and against each normal
+u32 frustum::classify(const aabb &box) const {
+  u32 res = INSIDE;
+  loopi(6) {
+    const vec3f n = planes[i].xyz();
+    const vec3<bool> pos = n >= vec3f(zero);
+    if (dot(n, select(pos, box.pmax, box.pmin)) + planes[i].w < 0.f) return OUTSIDE;
+    if (dot(n, select(pos, box.pmin, box.pmax)) + planes[i].w < 0.f) res = INTERSECT;
+  }
+  return res;
+}
+
 } // namespace cube
 
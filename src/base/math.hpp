@@ -573,7 +573,7 @@ TINLINE m44 lookat(v3arg eye, v3arg center, v3arg up) {
   dst.vx.x = s.x; dst.vy.x = s.y; dst.vz.x = s.z;
   dst.vx.y = t.x; dst.vy.y = t.y; dst.vz.y = t.z;
   dst.vx.z =-f.x; dst.vy.z =-f.y; dst.vz.z =-f.z;
-  return translate(dst, -eye);
+  return dst*m44::translate(-eye);
 }
 TINLINE m44 perspective(T fovy, T aspect, T znear, T zfar) {
   const T range = tan(deg2rad(fovy / T(two))) * znear;
@@ -865,10 +865,20 @@ struct aabb {
   vec3f pmin, pmax;
 };
 struct isecres {
+  INLINE isecres(void) {}
   INLINE isecres(bool isec, float t = FLT_MAX) : t(t), isec(isec) {}
   float t;
   bool isec;
 };
+// view frustum as six planes extracted from a view projection matrix. points
+// inside the frustum are on the positive side of every plane
+struct frustum {
+  enum {OUTSIDE, INTERSECT, INSIDE};
+  frustum(const mat4x4f &m);
+  u32 classify(const aabb &box) const;
+  vec4f planes[6];
+};
+
 INLINE bool intersect(const aabb &b0, const aabb &b1) {
   return !(any(b0.pmin > b1.pmax)| any(b1.pmin > b0.pmax));
 }
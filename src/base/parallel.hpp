@@ -0,0 +1,87 @@
+#pragma once
+#include "task.hpp"
+#include "vector.hpp"
+
+/*-------------------------------------------------------------------------
+ - parallel loops over the task sets. the range is cut in chunks of at least
+ - "grain" indices. chunks are small enough to give a few of them to every
+ - thread (the calling one included) and to balance the work. the caller runs
+ - chunks too while it waits. ranges with one chunk run inline
+ -------------------------------------------------------------------------*/
+namespace cube {
+
+// half open range of indices ("range" is already a loop macro)
+struct indexrange {
+  INLINE indexrange(void) {}
+  INLINE indexrange(u32 first, u32 last) : first(first), last(last) {}
+  INLINE u32 size(void) const { return last > first ? last-first : 0u; }
+  u32 first, last;
+};
+
+namespace tasking {
+static const u32 CHUNKS_PER_THREAD = 4;
+
+// chunk size for the given range and grain
+INLINE u32 chunksize(const indexrange &r, u32 grain) {
+  const u32 chunks = (threadnum()+1)*CHUNKS_PER_THREAD;
+  return max(max(grain, 1u), (r.size()+chunks-1)/chunks);
+}
+INLINE u32 chunknum(const indexrange &r, u32 chunk) { return (r.size()+chunk-1)/chunk; }
+INLINE indexrange chunkrange(const indexrange &r, u32 chunk, u32 idx) {
+  const u32 first = r.first+idx*chunk;
+  return indexrange(first, min(first+chunk, r.last));
+}
+
+template <typename F> struct parallelfortask : public task {
+  INLINE parallelfortask(const indexrange &r, u32 chunk, const F &f) :
+    task("parallelfor", chunknum(r,chunk), 1, 0, task::UNFAIR), r(r), chunk(chunk), f(f) {}
+  virtual void run(u32 idx) { f(chunkrange(r, chunk, idx)); }
+  indexrange r;
+  u32 chunk;
+  const F &f;
+};
+
+template <typename T, typename F> struct parallelreducetask : public task {
+  INLINE parallelreducetask(const indexrange &r, u32 chunk, T *partials, const F &f) :
+    task("parallelreduce", chunknum(r,chunk), 1, 0, task::UNFAIR),
+    r(r), chunk(chunk), partials(partials), f(f) {}
+  virtual void run(u32 idx) { partials[idx] = f(chunkrange(r, chunk, idx)); }
+  indexrange r;
+  u32 chunk;
+  T *partials;
+  const F &f;
+};
+} // namespace tasking
+
+// call f(indexrange) over chunks covering r
+template <typename F>
+void parallel_for(const indexrange &r, u32 grain, const F &f) {
+  const u32 chunk = tasking::chunksize(r, grain);
+  if (tasking::chunknum(r, chunk) <= 1 || tasking::threadnum() == 0) {
+    if (r.size() != 0) f(r);
+    return;
+  }
+  ref<task> job = NEW(tasking::parallelfortask<F>, r, chunk, f);
+  job->scheduled();
+  job->wait();
+}
+
+// f(indexrange) returns the partial result of a chunk. partials are kept per
+// chunk and combined in order with reduce(T,T). so the result does not depend
+// on the thread that ran the chunk
+template <typename T, typename F, typename R>
+T parallel_reduce(const indexrange &r, u32 grain, const T &identity, const F &f, const R &reduce) {
+  const u32 chunk = tasking::chunksize(r, grain), n = tasking::chunknum(r, chunk);
+  if (n <= 1 || tasking::threadnum() == 0)
+    return r.size() != 0 ? reduce(identity, f(r)) : identity;
+  typedef tasking::parallelreducetask<T,F> reducetask;
+  vector<T> partials(n);
+  ref<task> job = NEW(reducetask, r, chunk, &partials[0], f);
+  job->scheduled();
+  job->wait();
+  T result = identity;
+  loopi(s32(n)) result = reduce(result, partials[i]);
+  return result;
+}
+} // namespace cube
+
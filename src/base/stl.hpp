@@ -508,6 +508,8 @@ private:
 template<typename T> struct ref {
   INLINE ref(void) : ptr(NULL) {}
   INLINE ref(const ref &input) : ptr(input.ptr) { if (ptr) ptr->acquire(); }
+  // temporaries hand over their reference: no atomic operation
+  INLINE ref(ref &&input) : ptr(input.ptr) { input.ptr = NULL; }
   INLINE ref(T* const input) : ptr(input) { if (ptr) ptr->acquire(); }
   INLINE ~ref(void) { if (ptr) ptr->release();  }
   INLINE operator bool(void) const       { return ptr != NULL; }
@@ -517,12 +519,16 @@ template<typename T> struct ref {
   INLINE T& operator* (void) {return *ptr;}
   INLINE T* operator->(void) {return  ptr;}
   INLINE ref &operator= (const ref &input);
+  INLINE ref &operator= (ref &&input);
   INLINE ref &operator= (niltype);
   template<typename U> INLINE ref<U> cast(void) { return ref<U>((U*)(ptr)); }
   template<typename U> INLINE const ref<U> cast(void) const { return ref<U>((U*)(ptr)); }
   T* ptr;
 };
 
+// the counter only uses locked instructions. on x86, they are full barriers.
+// so, the release that frees the object always sees the writes done by the
+// other owners and relaxed or acquire-release variants would not be cheaper
 struct refcount {
   INLINE refcount(void) : refcounter(0) {}
   virtual ~refcount(void) {}
@@ -544,6 +550,15 @@ INLINE ref<T> &ref<T>::operator= (const ref<T> &input) {
   return *this;
 }
 template <typename T>
+INLINE ref<T> &ref<T>::operator= (ref<T> &&input) {
+  if (this == &input) return *this;
+  T *old = ptr;
+  *(T**)&ptr = input.ptr;
+  input.ptr = NULL;
+  if (old) old->release();
+  return *this;
+}
+template <typename T>
 INLINE ref<T> &ref<T>::operator= (niltype) {
   if (ptr) ptr->release();
   *(T**)&ptr = NULL;
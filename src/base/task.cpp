@@ -1,6 +1,7 @@
 #include "task.hpp"
 #include "vector.hpp"
 #include <SDL/SDL_thread.h>
+#include <cstdio>
 
 namespace cube {
 namespace tasking {
@@ -13,54 +14,306 @@ enum {
   DONE = 3
 };
 
+// priority classes. lower values run first
+enum {
+  PRIO_CRITICAL = 0,
+  PRIO_NORMAL = 1,
+  PRIO_BACKGROUND = 2,
+  PRIO_NUM = 3
+};
+
+// number of picks a class with ready tasks may miss before it is served first
+static const u32 STARVATION_LIMIT = 16;
+
 // all queues as instantiated by the user
 static vector<struct queue*> queues;
 
-static const u32 MAXSTART = 4; // maximum number of tasks we may start
-static const u32 MAXEND   = 4; // maximum number of tasks we may end
-static const u32 MAXDEP   = 8; // maximum number of tasks we may depend on
+// list of tasks growing by blocks. a few tasks are stored inline. blocks never
+// move. so, a thread may walk the list while another one appends to it.
+// appends are serialized by a spin lock and published by the count
+struct depblock {
+  static const u32 SIZE = 31;
+  task *tasks[SIZE];
+  depblock *next;
+};
+struct deplist : public noncopyable {
+  static const u32 INLINED = 2;
+  INLINE deplist(void) : num(0), lock(0), more(NULL), last(NULL) {}
+  ~deplist(void);
+  void add(task *job);
+  INLINE u32 size(void) const { return loadacquire(&num); }
+  template <typename F> void foreach(const F &f) const {
+    const u32 n = size(), inlinednum = n < INLINED ? n : INLINED;
+    for (u32 i = 0; i < inlinednum; ++i) f(inlined[i]);
+    u32 i = INLINED;
+    for (const depblock *b = more; i < n; b = b->next)
+      for (u32 j = 0; j < depblock::SIZE && i < n; ++j, ++i) f(b->tasks[j]);
+  }
+  volatile u32 num;
+  volatile s32 lock;
+  task *inlined[INLINED];
+  depblock *more, *last;
+};
+
+deplist::~deplist(void) {
+  while (more) {
+    depblock *next = more->next;
+    FREE(more);
+    more = next;
+  }
+}
+
+void deplist::add(task *job) {
+  while (atomic_cmpxchg(&lock, 1, 0) != 0) cpupause();
+  const u32 n = num;
+  if (n < INLINED)
+    inlined[n] = job;
+  else {
+    const u32 idx = (n-INLINED)%depblock::SIZE;
+    if (idx == 0) {
+      depblock *b = (depblock*) MALLOC(sizeof(depblock));
+      b->next = NULL;
+      if (n == INLINED) more = b; else last->next = b;
+      last = b;
+    }
+    last->tasks[idx] = job;
+  }
+  storerelease(&num, n+1);
+  storerelease(&lock, 0);
+}
 
 // internal hidden structure of the task
 struct MAYALIAS internal : public noncopyable, public intrusive_list_node {
   INLINE internal(const char *name, u32 n, u32 waiternum, u32 queue, u16 policy);
   INLINE task *parent(void);
+  INLINE u32 priority(void) const {
+    return (policy & task::HI_PRIO) ? PRIO_CRITICAL :
+           (policy & task::BG_PRIO) ? PRIO_BACKGROUND : PRIO_NORMAL;
+  }
+  // only default priority tasks with no deadline go to the deques
+  INLINE bool local(void) const { return deadline == 0 && priority() == PRIO_NORMAL; }
   void wait(bool recursivewait);
-  task *taskstostart[MAXSTART];// all the tasks that wait for us to start
-  task *taskstoend[MAXEND];    // all the tasks that wait for us to finish
-  task *deps[MAXDEP];          // all the tasks we depend on to finish or start
+  deplist taskstostart;        // all the tasks that wait for us to start
+  deplist taskstoend;          // all the tasks that wait for us to finish
+  deplist deps;                // all the tasks we depend on to finish or start
   tasking::queue *const owner; // where the task runs when ready
   const char *name;            // name of the task (may be NULL)
   atomic elemnum;              // number of items still to run in the set
   atomic tostart;              // mbz to start
   atomic toend;                // mbz to end
-  atomic depnum;               // number of tasks we depend to finish
   atomic waiternum;            // number of wait() that still need to be done
-  atomic tasktostartnum;       // number of tasks we need to start
-  atomic tasktoendnum;         // number of tasks we need to end
+  u64 deadline;                // latest start time in microseconds (0 if none)
+  internal *inboxnext;         // next task in the inbox of the queue
   const u16 policy;            // handle fairness and priority
   volatile u16 state;          // track task state (useful to debug)
 };
 static_assert(sizeof(internal) <= task::SIZE, "opaque storage is too small");
 static_assert(sizeof(task) == 256, "invalid task size");
 
-// a set of threads subscribes this queue and share the work in the list of the
-// tasks. threads terminate when "terminatethreads" become true
+// bounded work stealing deque (chase-lev). the owner thread pushes and pops at
+// the bottom while the other threads steal at the top. indices wrap around so
+// they are only compared through their difference
+struct CACHE_LINE_ALIGNED workdeque {
+  static const u32 CAPACITY = 1024;
+  INLINE workdeque(void) : top(0), bottom(0) {}
+  INLINE s32 size(void) const { return s32(u32(loadacquire(&bottom))-u32(loadacquire(&top))); }
+  bool push(internal *job);
+  internal *pop(void);
+  internal *steal(void);
+  volatile s32 top;
+  char pad[CACHE_LINE_ALIGNMENT-sizeof(s32)]; // thieves only touch the top
+  volatile s32 bottom;
+  internal *volatile items[CAPACITY];
+};
+
+bool workdeque::push(internal *job) {
+  const s32 b = bottom, t = loadacquire(&top);
+  if (s32(u32(b)-u32(t)) >= s32(CAPACITY)) return false;
+  items[u32(b)&(CAPACITY-1)] = job;
+  storerelease(&bottom, s32(u32(b)+1));
+  return true;
+}
+
+internal *workdeque::pop(void) {
+  const s32 b = s32(u32(bottom)-1);
+  bottom = b;
+  memoryfence();
+  const s32 t = top;
+  const s32 n = s32(u32(b)-u32(t));
+  if (n < 0) {
+    bottom = t;
+    return NULL;
+  }
+  internal *job = items[u32(b)&(CAPACITY-1)];
+  if (n > 0) return job;
+
+  // last one: we race with the thieves
+  if (atomic_cmpxchg(&top, s32(u32(t)+1), t) != t) job = NULL;
+  storerelease(&bottom, s32(u32(t)+1));
+  return job;
+}
+
+internal *workdeque::steal(void) {
+  const s32 t = loadacquire(&top);
+  const s32 b = loadacquire(&bottom);
+  if (s32(u32(b)-u32(t)) <= 0) return NULL;
+  internal *job = items[u32(t)&(CAPACITY-1)];
+  if (atomic_cmpxchg(&top, s32(u32(t)+1), t) != t) return NULL;
+  return job;
+}
+
+// a set of threads subscribes this queue. each of them owns a deque of ready
+// tasks and steals from the others when it runs dry. tasks made ready by other
+// threads go to the lock-free inbox. prioritized tasks and tasks with a
+// deadline go to the ready list of their class. threads terminate when
+// "terminatethreads" become true
 struct queue {
   queue(u32 threadnum);
   ~queue(void);
   void append(task*);
   void terminate(task*);
+  void push(internal&, bool wake);
+  void pushready(internal&);
+  void pushinbox(internal&);
+  internal *popinbox(void);
+  bool share(internal&);
+  internal *popready(u32 prio);
+  internal *poplate(void);
+  internal *getnormal(void);
+  internal *served(internal*);
+  internal *get(void);
+  bool haswork(void);
+  void wakeup(void);
+  void runelements(internal&);
+  void signal(void);
   static int threadfunc(void*);
   SDL_cond *cond;
   SDL_mutex *mutex;
   vector<SDL_Thread*> threads;
-  intrusive_list<internal> readylist;
+  workdeque *deques;                  // one per thread
+  void *volatile inbox;               // stack of the tasks pushed by others
+  intrusive_list<internal> readylists[PRIO_NUM]; // sorted by deadline first
+  atomic readynum[PRIO_NUM];          // size of each ready list
+  atomic deadlinenum;                 // tasks with a deadline in the lists
+  atomic sleepers;                    // threads waiting for work
+  atomic threadnum;                   // threads already started
+  atomic spinwakes, yieldwakes;       // work found while spinning or yielding
+  u32 parkwakes;                      // wake-ups from sleep. mutex held
+  u64 signaltime, wakeusec, maxwakeusec;
   volatile bool terminatethreads;
 };
 
+// idle policy shared by all queues
+static volatile u32 idlespin = 2000, idleyield = 16;
+
+// queue and deque of the current thread if it runs a queue
+static THREAD queue *threadqueue = NULL;
+static THREAD u32 threadid = 0;
+static THREAD u32 threadseed = 0;
+static THREAD u32 threadskips[PRIO_NUM]; // picks missed by each class
+
+/*-------------------------------------------------------------------------
+ - task timeline. each thread writes its events in its own ring buffer with
+ - no lock. only the registration of a new thread takes the trace mutex
+ -------------------------------------------------------------------------*/
+struct traceevent {
+  const char *name;
+  u64 begin, end;
+  s32 elt; // -1 when the thread sleeps
+};
+struct tracebuffer {
+  static const u32 CAPACITY = 1u<<16;
+  INLINE tracebuffer(u32 tid) : head(0), tid(tid) {}
+  traceevent events[CAPACITY];
+  volatile u32 head; // number of events ever written
+  u32 tid;
+  char name[32];
+};
+static volatile bool tracing = false;
+static SDL_mutex *tracemutex = NULL;
+static vector<tracebuffer*> tracebuffers;
+static THREAD tracebuffer *threadtrace = NULL;
+
+static tracebuffer *gettrace(void) {
+  if (threadtrace) return threadtrace;
+  SDL_LockMutex(tracemutex);
+    threadtrace = NEW(tracebuffer, tracebuffers.size());
+    if (threadqueue)
+      sprintf(threadtrace->name, "worker %u", threadid);
+    else
+      sprintf(threadtrace->name, "thread %u", threadtrace->tid);
+    tracebuffers.add(threadtrace);
+  SDL_UnlockMutex(tracemutex);
+  return threadtrace;
+}
+
+static void trace(const char *name, u64 begin, u64 end, s32 elt) {
+  tracebuffer *b = gettrace();
+  traceevent &e = b->events[b->head&(tracebuffer::CAPACITY-1)];
+  e.name = name ? name : "unnamed";
+  e.begin = begin;
+  e.end = end;
+  e.elt = elt;
+  storerelease(&b->head, b->head+1);
+}
+
+INLINE void runelement(task *job, const char *name, s32 elt) {
+  if (!tracing) {
+    job->run(elt);
+    return;
+  }
+  const u64 begin = microseconds();
+  job->run(elt);
+  trace(name, begin, microseconds(), elt);
+}
+
+void starttrace(void) {
+  SDL_LockMutex(tracemutex);
+    loopv(tracebuffers) storerelease(&tracebuffers[i]->head, 0u);
+  SDL_UnlockMutex(tracemutex);
+  storerelease(&tracing, true);
+}
+
+void stoptrace(void) { storerelease(&tracing, false); }
+
+// events still being written while tracing may be torn. stop first for a
+// clean dump
+s32 dumptrace(const char *filename) {
+  FILE *f = fopen(filename, "w");
+  if (f == NULL) return -1;
+  s32 n = 0;
+  u64 origin = ~u64(0);
+  SDL_LockMutex(tracemutex);
+  loopv(tracebuffers) {
+    const tracebuffer &b = *tracebuffers[i];
+    const u32 head = loadacquire(&b.head), num = min(head, tracebuffer::CAPACITY);
+    loopj(s32(num)) origin = min(origin, b.events[(head-num+j)&(tracebuffer::CAPACITY-1)].begin);
+  }
+  fprintf(f, "{\"traceEvents\":[\n");
+  loopv(tracebuffers) {
+    const tracebuffer &b = *tracebuffers[i];
+    fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,"
+               "\"args\":{\"name\":\"%s\"}}", n++ ? ",\n" : "", b.tid, b.name);
+    const u32 head = loadacquire(&b.head), num = min(head, tracebuffer::CAPACITY);
+    loopj(s32(num)) {
+      const traceevent &e = b.events[(head-num+j)&(tracebuffer::CAPACITY-1)];
+      const char *name = e.elt < 0 ? "sleep" : e.name;
+      fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,"
+                 "\"ts\":%llu,\"dur\":%llu,\"args\":{\"elt\":%d}}",
+              name, e.elt < 0 ? "idle" : "task", b.tid,
+              (unsigned long long)(e.begin-origin), (unsigned long long)(e.end-e.begin), e.elt);
+      ++n;
+    }
+  }
+  SDL_UnlockMutex(tracemutex);
+  fprintf(f, "\n]}\n");
+  fclose(f);
+  return n-tracebuffers.size();
+}
+
 INLINE internal::internal(const char *name, u32 n, u32 waiternum, u32 queue, u16 policy) :
   owner(tasking::queues[queue]), name(name), elemnum(n), tostart(1), toend(n),
-  depnum(0), waiternum(waiternum), tasktostartnum(0), tasktoendnum(0),
+  waiternum(waiternum), deadline(0), inboxnext(NULL),
   policy(policy), state(tasking::UNSCHEDULED)
 {}
 INLINE task *internal::parent(void) {
@@ -74,47 +327,243 @@ void internal::wait(bool recursivewait) {
   auto job = parent();
 
   // execute all starting dependencies
-  while (tostart)
-    loopi(depnum)
-      if (tasking::inner(deps[i]).toend)
-        inner(deps[i]).wait(true);
+  const auto help = [](task *dep) {
+    if (tasking::inner(dep).toend) inner(dep).wait(true);
+  };
+  while (tostart) deps.foreach(help);
 
-  // execute the run function
+  // execute the run function. the task may stay in some deques: they own a
+  // reference and just drop it once they see no more elements
   for (;;) {
     const auto elt = --elemnum;
-    if (elt == 0) {
-      SDL_LockMutex(owner->mutex);
-        owner->readylist.pop_front();
-      SDL_UnlockMutex(owner->mutex);
-    }
     if (elt >= 0) {
-      job->run(elt);
+      runelement(job, name, elt);
       if (--toend == 0) owner->terminate(job);
     }
     if (elt <= 0) break;
   }
 
   // execute all ending dependencies
-  while (toend)
-    loopi(depnum)
-      if (tasking::inner(deps[i]).toend)
-        inner(deps[i]).wait(true);
+  while (toend) deps.foreach(help);
 
   // finished and no more waiters, we can safely release the dependency array
   if (!recursivewait && --waiternum == 0)
-    loopi(depnum) deps[i]->release();
+    deps.foreach([](task *dep) { dep->release(); });
+}
+
+// every entry in a deque, in the inbox or in a ready list holds a reference on
+// the task. the caller gives it to us. only the ordered ready lists take the
+// mutex. with no wake-up, the caller wakes the threads up once it is done.
+// with no thread, nobody would pop the entry: the task only runs when waited
+void queue::push(internal &self, bool wake) {
+  if (threads.size() == 0) {
+    self.parent()->release();
+    return;
+  }
+  if (self.local()) {
+    if (threadqueue != this || !deques[threadid].push(&self)) pushinbox(self);
+    if (wake) wakeup();
+    return;
+  }
+  SDL_LockMutex(mutex);
+    pushready(self);
+  SDL_UnlockMutex(mutex);
+}
+
+void queue::pushinbox(internal &self) {
+  void *first;
+  do {
+    first = loadacquire(&inbox);
+    self.inboxnext = (internal*) first;
+  } while (atomic_cmpxchgptr(&inbox, &self, first) != first);
+}
+
+// we take the whole inbox at once so the tasks pushed meanwhile do not matter
+// (no aba). we keep the oldest one and move the others to our deque
+internal *queue::popinbox(void) {
+  void *first;
+  do {
+    if ((first = loadacquire(&inbox)) == NULL) return NULL;
+  } while (atomic_cmpxchgptr(&inbox, NULL, first) != first);
+  internal *oldest = NULL, *job = (internal*) first;
+  bool pushed = false;
+  while (job) {
+    internal *next = job->inboxnext;
+    if (next == NULL)
+      oldest = job;
+    else if (deques[threadid].push(job))
+      pushed = true;
+    else
+      pushinbox(*job);
+    job = next;
+  }
+  if (pushed) wakeup();
+  return oldest;
+}
+
+// mutex must be held. tasks with a deadline come first, earliest first
+void queue::pushready(internal &self) {
+  const u32 prio = self.priority();
+  auto &list = readylists[prio];
+  if (self.deadline == 0)
+    list.push_back(&self);
+  else {
+    auto it = list.begin();
+    while (it != list.end() && it->deadline != 0 && it->deadline <= self.deadline) ++it;
+    list.insert(it, &self);
+    ++deadlinenum;
+  }
+  ++readynum[prio];
+  if (sleepers != 0) signal();
+}
+
+// mutex must be held
+void queue::signal(void) {
+  signaltime = microseconds();
+  SDL_CondSignal(cond);
+}
+
+// make the remaining elements of a task we run visible to the other threads.
+// the ready list holds a task only once: another thread may have put it back
+bool queue::share(internal &self) {
+  if (!self.local()) {
+    SDL_LockMutex(mutex);
+      if (!self.in_list()) {
+        self.parent()->acquire();
+        pushready(self);
+      }
+    SDL_UnlockMutex(mutex);
+    return true;
+  }
+  self.parent()->acquire();
+  if (deques[threadid].push(&self)) {
+    wakeup();
+    return true;
+  }
+  self.parent()->release();
+  return false;
+}
+
+// the sleeping thread increments sleepers and then looks for work. we push and
+// then look for sleepers. the fences make sure one of us sees the other
+void queue::wakeup(void) {
+  memoryfence();
+  if (sleepers == 0) return;
+  SDL_LockMutex(mutex);
+    signal();
+  SDL_UnlockMutex(mutex);
+}
+
+bool queue::haswork(void) {
+  if (loadacquire(&inbox) != NULL) return true;
+  loopi(PRIO_NUM) if (readynum[i] != 0) return true;
+  loopv(threads) if (deques[i].size() > 0) return true;
+  return false;
+}
+
+internal *queue::popready(u32 prio) {
+  if (readynum[prio] == 0) return NULL;
+  internal *job = NULL;
+  auto &list = readylists[prio];
+  SDL_LockMutex(mutex);
+    if (!list.empty()) {
+      job = list.front();
+      list.pop_front();
+      --readynum[prio];
+      if (job->deadline != 0) --deadlinenum;
+    }
+  SDL_UnlockMutex(mutex);
+  return job;
+}
+
+// lists are sorted by deadline so only their first tasks may be late
+internal *queue::poplate(void) {
+  const u64 now = microseconds();
+  internal *job = NULL;
+  SDL_LockMutex(mutex);
+    loopi(PRIO_NUM) {
+      auto &list = readylists[i];
+      if (list.empty() || list.front()->deadline == 0 || list.front()->deadline > now)
+        continue;
+      job = list.front();
+      list.pop_front();
+      --readynum[i];
+      --deadlinenum;
+      break;
+    }
+  SDL_UnlockMutex(mutex);
+  return job;
+}
+
+// default priority: ready list, inbox, then our deque and finally the other
+// deques starting from a random one
+internal *queue::getnormal(void) {
+  internal *job = NULL;
+  if ((job = popready(PRIO_NORMAL)) != NULL) return job;
+  if ((job = popinbox()) != NULL) return job;
+  if ((job = deques[threadid].pop()) != NULL) return job;
+  const u32 n = threads.size();
+  threadseed = threadseed*1103515245u+12345u;
+  const u32 first = (threadseed>>16)%n;
+  loopi(s32(n)) {
+    const u32 victim = (first+i)%n;
+    if (victim == threadid) continue;
+    if ((job = deques[victim].steal()) != NULL) return job;
+  }
+  return NULL;
+}
+
+// the lower classes still waiting missed one more pick
+internal *queue::served(internal *job) {
+  const u32 prio = job->priority();
+  threadskips[prio] = 0;
+  rangei(s32(prio)+1, PRIO_NUM) {
+    const bool waiting = readynum[i] != 0 ||
+      (i == PRIO_NORMAL && deques[threadid].size() > 0);
+    if (waiting) threadskips[i]++;
+  }
+  return job;
+}
+
+// late tasks first, then the starving classes and finally the classes by
+// priority
+internal *queue::get(void) {
+  internal *job = NULL;
+  if (deadlinenum != 0 && (job = poplate()) != NULL) return served(job);
+  if (threadskips[PRIO_BACKGROUND] >= STARVATION_LIMIT &&
+      (job = popready(PRIO_BACKGROUND)) != NULL) return served(job);
+  if (threadskips[PRIO_NORMAL] >= STARVATION_LIMIT &&
+      (job = getnormal()) != NULL) return served(job);
+  if ((job = popready(PRIO_CRITICAL)) != NULL) return served(job);
+  if ((job = getnormal()) != NULL) return served(job);
+  if ((job = popready(PRIO_BACKGROUND)) != NULL) return served(job);
+  return NULL;
+}
+
+// if unfair, we run all elements until there is nothing else to do in this
+// job. if fair, we run once and go back to the queue to possibly run something
+// with a higher priority that just arrived. in both cases, the remaining elements are
+// shared first with the other threads
+void queue::runelements(internal &self) {
+  auto job = self.parent();
+  bool shared = false;
+  for (;;) {
+    const auto elt = --self.elemnum;
+    if (elt > 0 && !shared) shared = share(self);
+    if (elt >= 0) {
+      runelement(job, self.name, elt);
+      if (--self.toend == 0) terminate(job);
+    }
+    if (elt <= 0 || !(self.policy & task::UNFAIR)) break;
+  }
+  job->release();
 }
 
 void queue::append(task *job) {
   auto &self = inner(job);
   ASSERT(self.owner == this && self.tostart == 0);
-  SDL_LockMutex(self.owner->mutex);
-    if (self.policy & task::HI_PRIO)
-      self.owner->readylist.push_front(&self);
-    else
-      self.owner->readylist.push_back(&self);
-  SDL_CondBroadcast(cond);
-  SDL_UnlockMutex(self.owner->mutex);
+  job->acquire();
+  push(self, true);
 }
 
 void queue::terminate(task *job) {
@@ -122,77 +571,94 @@ void queue::terminate(task *job) {
   ASSERT(self.owner == this && self.toend == 0);
   storerelease(&self.state, u16(DONE));
 
-  // go over all tasks that depend on us
-  loopi(self.tasktostartnum) {
-    if (--inner(self.taskstostart[i]).tostart == 0)
-      append(self.taskstostart[i]);
-    self.taskstostart[i]->release();
-  }
-  loopi(self.tasktoendnum) {
-    if (--inner(self.taskstoend[i]).toend == 0)
-      terminate(self.taskstoend[i]);
-    self.taskstoend[i]->release();
-  }
+  // go over all tasks that depend on us. a task we start gets the reference
+  // our list holds on it and the threads are woken up once for all of them
+  bool started = false;
+  self.taskstostart.foreach([&](task *other) {
+    auto &dep = inner(other);
+    if (--dep.tostart != 0) {
+      other->release();
+      return;
+    }
+    ASSERT(dep.owner == this);
+    push(dep, false);
+    started = true;
+  });
+  if (started) wakeup();
+  self.taskstoend.foreach([&](task *other) {
+    if (--inner(other).toend == 0) terminate(other);
+    other->release();
+  });
 
   // if no more waiters, we can safely free all dependencies since we are done
   if (self.waiternum == 0)
-    loopi(self.depnum) self.deps[i]->release();
+    self.deps.foreach([](task *dep) { dep->release(); });
   job->release();
 }
 
 int queue::threadfunc(void *data) {
   auto q = (queue*) data;
+  threadqueue = q;
+  threadid = q->threadnum++;
+  threadseed = threadid+1;
+  u32 idle = 0; // failed attempts to get work
   for (;;) {
-    SDL_LockMutex(q->mutex);
-    while (q->readylist.empty() && !q->terminatethreads)
-      SDL_CondWait(q->cond, q->mutex);
-    if (q->terminatethreads) {
-      SDL_UnlockMutex(q->mutex);
-      break;
+    const u32 spinnum = loadacquire(&idlespin), yieldnum = loadacquire(&idleyield);
+    if (internal *job = q->get()) {
+      if (idle != 0) ++(idle <= spinnum ? q->spinwakes : q->yieldwakes);
+      idle = 0;
+      q->runelements(*job);
+      continue;
     }
-    auto &self = *q->readylist.front();
-    auto job = self.parent();
 
-    // if unfair, we run all elements until there is nothing else to do in this
-    // job. we do not care if a hi-prio job arrives while we run
-    if (self.policy & task::UNFAIR) {
-      job->acquire();
-      SDL_UnlockMutex(q->mutex);
-      for (;;) {
-        const auto elt = --self.elemnum;
-        if (elt >= 0) {
-          job->run(elt);
-          if (--self.toend == 0) q->terminate(job);
-        }
-        if (elt == 0) {
-          SDL_LockMutex(q->mutex);
-            q->readylist.pop_front();
-          SDL_UnlockMutex(q->mutex);
-        }
-        if (elt <= 0) break;
+    // nothing to do: spin, then yield and finally sleep
+    if (idle < spinnum) {
+      while (idle < spinnum && !q->haswork()) {
+        cpupause();
+        ++idle;
       }
-      job->release();
+      continue;
     }
-    // if fair, we run once and go back to the queue to possibly run something
-    // with hi-prio that just arrived
-    else {
-      const auto elt = --self.elemnum;
-      if (elt == 0) q->readylist.pop_front();
+    if (idle < spinnum+yieldnum) {
+      ++idle;
+      yieldthread();
+      continue;
+    }
+    idle = 0;
+    SDL_LockMutex(q->mutex);
+    if (q->terminatethreads) {
       SDL_UnlockMutex(q->mutex);
-      if (elt >= 0) {
-        job->run(elt);
-        if (--self.toend == 0) q->terminate(job);
+      break;
+    }
+    ++q->sleepers;
+    if (!q->haswork()) {
+      const u64 begin = microseconds();
+      SDL_CondWait(q->cond, q->mutex);
+      const u64 end = microseconds();
+      if (q->signaltime >= begin) {
+        const u64 latency = end-min(q->signaltime, end);
+        q->parkwakes++;
+        q->wakeusec += latency;
+        q->maxwakeusec = max(q->maxwakeusec, latency);
       }
+      if (tracing) trace(NULL, begin, end, -1);
     }
+    --q->sleepers;
+    SDL_UnlockMutex(q->mutex);
   }
-
   return 0;
 }
 
-queue::queue(u32 threadnum) : terminatethreads(false) {
+queue::queue(u32 n) :
+  inbox(NULL), deadlinenum(0), sleepers(0), threadnum(0), spinwakes(0), yieldwakes(0),
+  parkwakes(0), signaltime(0), wakeusec(0), maxwakeusec(0), terminatethreads(false)
+{
+  loopi(PRIO_NUM) readynum[i] = 0;
   mutex = SDL_CreateMutex();
   cond = SDL_CreateCond();
-  loopi(s32(threadnum)) threads.push_back(SDL_CreateThread(threadfunc, this));
+  deques = NEWAE(workdeque, max(n,1u));
+  threads.resize(n);
+  loopi(s32(n)) threads[i] = SDL_CreateThread(threadfunc, this);
 }
 
 queue::~queue(void) {
@@ -201,11 +667,26 @@ queue::~queue(void) {
   SDL_CondBroadcast(cond);
   SDL_UnlockMutex(mutex);
   loopv(threads) SDL_WaitThread(threads[i], NULL);
+
+  // drop the references of the entries nobody ran
+  loopi(PRIO_NUM) while (!readylists[i].empty()) {
+    internal *job = readylists[i].front();
+    readylists[i].pop_front();
+    job->parent()->release();
+  }
+  for (auto job = (internal*) inbox; job != NULL;) {
+    internal *next = job->inboxnext;
+    job->parent()->release();
+    job = next;
+  }
+  loopv(threads) while (internal *job = deques[i].pop()) job->parent()->release();
   SDL_DestroyMutex(mutex);
   SDL_DestroyCond(cond);
+  SAFE_DELETEA(deques);
 }
 
 void init(const u32 *queueinfo, u32 n) {
+  tracemutex = SDL_CreateMutex();
   queues.resize(n);
   loopi(s32(n)) queues[i] = NEW(queue, queueinfo[i]);
 }
@@ -213,6 +694,47 @@ void init(const u32 *queueinfo, u32 n) {
 void clean(void) {
   loopv(queues) SAFE_DELETE(queues[i]);
   queues.resize(0);
+  tracing = false;
+  loopv(tracebuffers) SAFE_DELETE(tracebuffers[i]);
+  tracebuffers.resize(0);
+  threadtrace = NULL;
+  SDL_DestroyMutex(tracemutex);
+  tracemutex = NULL;
+}
+
+u32 threadnum(u32 queue) {
+  return queue < u32(queues.size()) ? u32(queues[queue]->threads.size()) : 0u;
+}
+
+void setidle(u32 spinnum, u32 yieldnum) {
+  storerelease(&idlespin, spinnum);
+  storerelease(&idleyield, yieldnum);
+}
+
+idlestats getidlestats(u32 queue) {
+  idlestats stats;
+  memset(&stats, 0, sizeof(stats));
+  if (queue >= u32(queues.size())) return stats;
+  tasking::queue *q = queues[queue];
+  SDL_LockMutex(q->mutex);
+    stats.spinwakes = q->spinwakes;
+    stats.yieldwakes = q->yieldwakes;
+    stats.parkwakes = q->parkwakes;
+    stats.wakeusec = q->wakeusec;
+    stats.maxwakeusec = q->maxwakeusec;
+  SDL_UnlockMutex(q->mutex);
+  return stats;
+}
+
+void resetidlestats(u32 queue) {
+  if (queue >= u32(queues.size())) return;
+  tasking::queue *q = queues[queue];
+  SDL_LockMutex(q->mutex);
+    q->spinwakes = 0;
+    q->yieldwakes = 0;
+    q->parkwakes = 0;
+    q->wakeusec = q->maxwakeusec = 0;
+  SDL_UnlockMutex(q->mutex);
 }
 } // namespace tasking
 
@@ -234,17 +756,20 @@ void task::scheduled(void) {
   }
 }
 
+void task::deadline(u64 usec) {
+  auto &self = tasking::inner(this);
+  ASSERT(self.state == tasking::UNSCHEDULED);
+  self.deadline = usec;
+}
+
 void task::wait(void) { tasking::inner(this).wait(false); }
 
 void task::starts(task &dep) {
   auto &self = tasking::inner(this);
   auto &other = tasking::inner(&dep);
   ASSERT(self.state == tasking::UNSCHEDULED && other.state == tasking::UNSCHEDULED);
-  const u32 startindex = self.tasktostartnum++;
-  const u32 depindex = other.depnum++;
-  ASSERT(startindex < tasking::MAXSTART && depindex < tasking::MAXDEP);
-  self.taskstostart[startindex] = &dep;
-  other.deps[depindex] = this;
+  self.taskstostart.add(&dep);
+  other.deps.add(this);
   acquire();
   dep.acquire();
   other.tostart++;
@@ -254,11 +779,8 @@ void task::ends(task &dep) {
   auto &self = tasking::inner(this);
   auto &other = tasking::inner(&dep);
   ASSERT(self.state == tasking::UNSCHEDULED && other.state < tasking::DONE);
-  const u32 endindex = self.tasktoendnum++;
-  const u32 depindex = other.depnum++;
-  ASSERT(endindex < tasking::MAXEND && depindex < tasking::MAXDEP);
-  self.taskstoend[endindex] = &dep;
-  other.deps[depindex] = this;
+  self.taskstoend.add(&dep);
+  other.deps.add(this);
   acquire();
   dep.acquire();
   other.toend++;
@@ -9,6 +9,26 @@ namespace cube {
 namespace tasking {
   void init(const u32 *queueinfo, u32 n);
   void clean(void);
+  // number of threads running the tasks of the given queue
+  u32 threadnum(u32 queue=0);
+  // idle threads look for work "spinnum" times with a pause in between, then
+  // yield "yieldnum" times and finally sleep until a task is pushed
+  void setidle(u32 spinnum, u32 yieldnum);
+  // where the idle threads of a queue were when work showed up. the wake
+  // latency goes from the signal to the sleeping thread to its wake-up
+  struct idlestats {
+    u32 spinwakes, yieldwakes, parkwakes;
+    u64 wakeusec, maxwakeusec; // total and maximum wake latency
+  };
+  idlestats getidlestats(u32 queue=0);
+  void resetidlestats(u32 queue=0);
+  // task timeline. once started, every thread records when it runs task
+  // elements and when it sleeps in its own ring buffer
+  void starttrace(void);
+  void stoptrace(void);
+  // write the recorded events as a chrome trace (chrome://tracing). return
+  // the number of events or -1 if the file cannot be written
+  s32 dumptrace(const char *filename);
 } // namespace tasking
 
 class CACHE_LINE_ALIGNED task : public noncopyable, public refcount {
@@ -19,9 +39,16 @@ public:
   void ends(task&);
   void wait(void);
   void scheduled(void);
+  // absolute time (see microseconds()) before which the task should start.
+  // ready tasks run by earliest deadline in their priority class and a late
+  // task runs before anything else. call before scheduled()
+  void deadline(u64 usec);
   virtual void run(u32);
+  // priority classes: frame critical (HI_PRIO), default (LO_PRIO) and
+  // background (BG_PRIO). a class waiting for too long gets served anyway
   static const u32 LO_PRIO = 0u;
   static const u32 HI_PRIO = 1u;
+  static const u32 BG_PRIO = 4u;
   static const u32 FAIR    = 0u;
   static const u32 UNFAIR  = 2u;
   static const u32 SIZE    = 192u;
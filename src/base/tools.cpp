@@ -8,6 +8,12 @@
 #if !defined(__MSVC__)
 #include "unistd.h"
 #endif
+#if defined(__WIN32__)
+#include <windows.h>
+#else
+#include <time.h>
+#include <sched.h>
+#endif // __WIN32__
 
 namespace cube {
 
@@ -121,6 +127,27 @@ void *memrealloc(void *ptr, size_t sz, const char *, int) {return realloc(ptr,sz
 void memfree(void *ptr) {free(ptr);}
 #endif // defined(MEMORY_DEBUGGER)
 
+u64 microseconds(void) {
+#if defined(__WIN32__)
+  LARGE_INTEGER freq, t;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&t);
+  return u64(t.QuadPart)*1000000/u64(freq.QuadPart);
+#else
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return u64(t.tv_sec)*1000000 + u64(t.tv_nsec)/1000;
+#endif // __WIN32__
+}
+
+void yieldthread(void) {
+#if defined(__WIN32__)
+  SwitchToThread();
+#else
+  sched_yield();
+#endif // __WIN32__
+}
+
 void writebmp(const int *data, int w, int h, const char *filename) {
   int x, y;
   FILE *fp = fopen(filename, "wb");
@@ -274,6 +274,15 @@ template<class T> INLINE typename remove_reference<T>::type&& move(T&& t) {
   return static_cast<typename remove_reference<T>::type&&>(t);
 }
 
+// index of the lowest / highest set bit. x must not be zero
+#if defined(__MSVC__)
+INLINE u32 bsf(u32 x) { unsigned long r; _BitScanForward(&r,x); return r; }
+INLINE u32 bsr(u32 x) { unsigned long r; _BitScanReverse(&r,x); return r; }
+#else
+INLINE u32 bsf(u32 x) { return __builtin_ctz(x); }
+INLINE u32 bsr(u32 x) { return 31-__builtin_clz(x); }
+#endif // __MSVC__
+
 /*-------------------------------------------------------------------------
  - memory debugging / tracking facilities
  -------------------------------------------------------------------------*/
@@ -317,6 +326,10 @@ template <typename T> INLINE void memdestroya(T *array) {
 
 void fatal(const char *s, const char *o = "");
 void keyrepeat(bool on);
+// monotonic clock for timings finer than a millisecond
+u64 microseconds(void);
+// give the rest of the time slice to another thread
+void yieldthread(void);
 
 static const int KB = 1024;
 static const int MB = KB*KB;
@@ -331,6 +344,9 @@ INLINE s32 atomic_add(volatile s32* m, const s32 v) {
 INLINE s32 atomic_cmpxchg(volatile s32* m, const s32 v, const s32 c) {
   return _InterlockedCompareExchange((volatile long*)m,v,c);
 }
+INLINE void *atomic_cmpxchgptr(void *volatile *m, void *v, void *c) {
+  return _InterlockedCompareExchangePointer(m,v,c);
+}
 #elif defined(__JAVASCRIPT__)
 INLINE s32 atomic_add(s32 volatile* value, s32 input) {
   const s32 initial = value;
@@ -342,6 +358,11 @@ INLINE s32 atomic_cmpxchg(volatile s32* m, const s32 v, const s32 c) {
   if (*m == c) *m = v;
   return initial;
 }
+INLINE void *atomic_cmpxchgptr(void *volatile *m, void *v, void *c) {
+  void *initial = *m;
+  if (*m == c) *m = v;
+  return initial;
+}
 #else
 INLINE s32 atomic_add(s32 volatile* value, s32 input) {
   asm volatile("lock xadd %0,%1" : "+r"(input), "+m"(*value) : "r"(input), "m"(*value));
@@ -352,6 +373,11 @@ INLINE s32 atomic_cmpxchg(s32 volatile* value, const s32 input, s32 comparand) {
   asm volatile("lock cmpxchg %2,%0" : "=m"(*value), "=a"(comparand) : "r"(input), "m"(*value), "a"(comparand) : "flags");
   return comparand;
 }
+
+INLINE void *atomic_cmpxchgptr(void *volatile *value, void *input, void *comparand) {
+  asm volatile("lock cmpxchg %2,%0" : "=m"(*value), "=a"(comparand) : "r"(input), "m"(*value), "a"(comparand) : "flags");
+  return comparand;
+}
 #endif // __MSVC__
 
 #if defined(__X86__) || defined(__X86_64__) || defined(__JAVASCRIPT__)
@@ -372,6 +398,24 @@ INLINE void storerelease(volatile T *ptr, T x) {
 #error "unknown platform"
 #endif
 
+// full barrier: stores before it are visible before loads after it
+#if defined(__MSVC__)
+INLINE void memoryfence(void) { _mm_mfence(); }
+#elif defined(__JAVASCRIPT__)
+INLINE void memoryfence(void) { COMPILER_READ_WRITE_BARRIER; }
+#else
+INLINE void memoryfence(void) { asm volatile("mfence" ::: "memory"); }
+#endif // __MSVC__
+
+// hint for spin-wait loops
+#if defined(__MSVC__)
+INLINE void cpupause(void) { _mm_pause(); }
+#elif defined(__JAVASCRIPT__)
+INLINE void cpupause(void) {}
+#else
+INLINE void cpupause(void) { asm volatile("pause" ::: "memory"); }
+#endif // __MSVC__
+
 struct atomic : noncopyable {
 public:
   INLINE atomic(void) {}
@@ -388,5 +432,14 @@ public:
 private:
   volatile s32 data;
 };
+
+// for short critical sections. waiters spin and never sleep
+struct spinlock : noncopyable {
+  INLINE spinlock(void) : locked(0) {}
+  INLINE void lock(void) { while (atomic_cmpxchg(&locked, 1, 0) != 0) cpupause(); }
+  INLINE void unlock(void) { storerelease(&locked, s32(0)); }
+private:
+  volatile s32 locked;
+};
 } // namespace cube
 
@@ -1,3 +1,5 @@
+#include "asset.cpp"
+#include "brickmesh.cpp"
 #include "bvh.cpp"
 #include "client.cpp"
 #include "command.cpp"
@@ -5,14 +7,18 @@
 #include "editing.cpp"
 #include "entities.cpp"
 #include "game.cpp"
+#include "occlusion.cpp"
 #include "ogl.cpp"
+#include "oglrecord.cpp"
 #include "main.cpp"
 #include "math.cpp"
 #include "menu.cpp"
+#include "meshpool.cpp"
 #include "monster.cpp"
 #include "network.cpp"
 #include "physics.cpp"
 #include "renderer.cpp"
+#include "rendercpu.cpp"
 #include "renderextras.cpp"
 #include "rendermd2.cpp"
 #include "renderparticles.cpp"
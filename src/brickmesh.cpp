@@ -0,0 +1,395 @@
+#include "brickmesh.hpp"
+
+namespace cube {
+namespace world {
+
+meshblob *newmeshblob(u32 vertnum, u32 indexnum, u32 drawnum) {
+  const size_t sz = sizeof(meshblob) + vertnum*sizeof(gridvertex) +
+                    (indexnum+(indexnum&1))*sizeof(u16) + drawnum*sizeof(vec2i);
+  meshblob *blob = (meshblob*) MALLOC(sz);
+  blob->vertnum = vertnum;
+  blob->indexnum = indexnum;
+  blob->drawnum = drawnum;
+  return blob;
+}
+void deletemeshblob(meshblob *blob) { FREE(blob); }
+
+void buildfacemasks(bricksnapshot &s) {
+  loopxyz(0, brickisize, {
+    const vec3i p = s.org+xyz;
+    u8 mask = 0;
+    if (s.occupied(p))
+      loopk(6) if (!s.occupied(p+cubenorms[k])) mask |= 1<<k;
+    s.faces[X][Y][Z] = mask;
+  });
+}
+
+/*-------------------------------------------------------------------------
+ - surface parameterization per brick. visible faces are processed per
+ - orientation and per slice of the brick. undeformed coplanar faces with the
+ - same texture are greedily merged in rectangles which get one light map
+ - quad. every face of a rectangle still gets its own UVs inside it
+ -------------------------------------------------------------------------*/
+struct surfaceparamctx {
+  INLINE surfaceparamctx(const bricksnapshot &s, lightmapuv &lmuv,
+                         vector<lightmapquad> &quads, int lmres, bool greedy) :
+    s(s), lmuv(lmuv), quads(quads), lmres(lmres), rowh(0), face(0), greedy(greedy) {}
+  INLINE void set(vec3i idx, vec2i uv, u32 corner) {lmuv.set(idx, uv, corner, face);}
+  const bricksnapshot &s;
+  lightmapuv &lmuv;
+  vector<lightmapquad> &quads;
+  int lmres;
+  int rowh; // height of the current row of quads in the light map
+  u32 face;
+  bool greedy;
+};
+
+// faces with a displaced corner are never merged
+static bool flatface(const bricksnapshot &s, vec3i xyz, u32 face) {
+  const vec4i q = cubequads[face];
+  loopi(4) if (any(s.get(xyz+cubeiverts[q[i]]).p != vec3<s8>(zero))) return false;
+  return true;
+}
+
+// rows of the light map only go down such that refined rows can be uploaded
+// in quad order
+static vec2i allocatelm(surfaceparamctx &ctx, vec2i texn) {
+  vec2i &dim = ctx.lmuv.dim;
+  if (dim.x+texn.x+2 >= maxlmw) {
+    dim.x = 0;
+    dim.y += ctx.rowh;
+    ctx.rowh = 0;
+  }
+  const vec2i uv = dim;
+  dim.x += texn.x+2;
+  ctx.rowh = max(ctx.rowh, texn.y+2);
+  return uv;
+}
+
+// size is the number of faces along the u and the v edges of the face
+static void buildlmrect(surfaceparamctx &ctx, vec3i idx, vec2i size) {
+  const int lmres = ctx.lmres;
+  const vec2i uv = allocatelm(ctx, lmres*vec2i(size.y,size.x));
+  const vec3i u = quadu(ctx.face), v = quadv(ctx.face);
+  loopi(size.x) loopj(size.y) {
+    const vec3i cell = idx+i*u+j*v;
+    const vec2i first = uv+lmres*vec2i(j,i);
+    ctx.set(cell, first, 0);
+    ctx.set(cell, first+vec2i(lmres,0), 1);
+    ctx.set(cell, first+vec2i(lmres), 2);
+    ctx.set(cell, first+vec2i(0,lmres), 3);
+  }
+  ctx.quads.add(lightmapquad(ctx.s.org+idx, uv, ctx.face, size));
+}
+
+static void buildlmslice(surfaceparamctx &ctx, int slice) {
+  enum {NONE, SINGLE, MERGEABLE};
+  const u32 face = ctx.face;
+  const vec3i u = quadu(face), v = quadv(face);
+  const int ua = u.x?0:(u.y?1:2), va = v.x?0:(v.y?1:2);
+  u8 state[lvl1][lvl1];
+  u16 tex[lvl1][lvl1];
+  const auto local = [&](int i, int j) {
+    vec3i idx;
+    idx[face/2] = slice;
+    idx[ua] = i;
+    idx[va] = j;
+    return idx;
+  };
+  loopi(lvl1) loopj(lvl1) {
+    const vec3i xyz = ctx.s.org+local(i,j);
+    state[i][j] = NONE;
+    if (!ctx.s.visibleface(xyz, face)) continue;
+    const bool merge = ctx.greedy && flatface(ctx.s, xyz, face);
+    state[i][j] = merge ? MERGEABLE : SINGLE;
+    tex[i][j] = ctx.s.get(xyz).tex[face];
+  }
+
+  // grow along v first and then along u as long as the whole row matches
+  loopi(lvl1) loopj(lvl1) {
+    if (state[i][j] == NONE) continue;
+    int w = 1, h = 1;
+    if (state[i][j] == MERGEABLE) {
+      const u16 t = tex[i][j];
+      while (j+w<lvl1 && state[i][j+w]==MERGEABLE && tex[i][j+w]==t) ++w;
+      for (;;) {
+        if (i+h == lvl1) break;
+        bool row = true;
+        loopk(w) if (state[i+h][j+k]!=MERGEABLE || tex[i+h][j+k]!=t) {
+          row = false;
+          break;
+        }
+        if (!row) break;
+        ++h;
+      }
+    }
+    loopk(h) loop(m,w) state[i+k][j+m] = NONE;
+
+    // the first corner of the rectangle is the one of the face quad
+    const int i0 = u[ua] > 0 ? i : i+h-1;
+    const int j0 = v[va] > 0 ? j : j+w-1;
+    buildlmrect(ctx, local(i0,j0), vec2i(h,w));
+  }
+}
+
+static void buildlmuv(surfaceparamctx &ctx) {
+  loopi(6) {
+    ctx.face = i;
+    loopj(lvl1) buildlmslice(ctx, j);
+  }
+  if (ctx.rowh == 0) ctx.rowh = ctx.lmres+2;
+  ctx.lmuv.dim.x = maxlmw;
+  ctx.lmuv.dim.y += ctx.rowh;
+}
+
+/*-------------------------------------------------------------------------
+ - brick meshing (very simple for now)
+ -------------------------------------------------------------------------*/
+struct brickmeshctx {
+  INLINE brickmeshctx(const bricksnapshot &s, const lightmapuv &lmuv) :
+    s(s), lmuv(lmuv) {}
+  INLINE void clear(s32 orientation) {
+    face = orientation;
+    MEMSET(indices, 0xff);
+  }
+  INLINE u16 get(vec3i p) const { return indices[p.x][p.y][p.z]; }
+  INLINE void set(vec3i p, u16 idx) { indices[p.x][p.y][p.z] = idx; }
+  const bricksnapshot &s;
+  const lightmapuv &lmuv;
+  vector<gridvertex> vbo;
+  vector<u16> ibo;
+  vector<u16> tex;
+  u16 indices[lvl1+1][lvl1+1][lvl1+1];
+  s32 face;
+};
+
+static gridvertex makevertex(const bricksnapshot &s, vec3i idx, u32 face, vec2i lm) {
+  const vec3i pos = gridvertex::unit*idx + vec3i(s.get(s.org+idx).p);
+  const int chan = face/2; // basically: x (0), y (1) or z (2)
+  gridvertex v;
+  v.pos = vec3<s16>(pos.xzy());
+  v.pad = 0;
+  v.tex = vec2<s16>(chan==0?pos.yz():(chan==1?pos.xz():pos.xy()));
+  v.lm = vec2<u16>(lm);
+  return v;
+}
+
+// the cache only keeps the last vertex output at each position. it is reused
+// if it is exactly the same
+static u16 addvertex(brickmeshctx &ctx, vec3i idx, const gridvertex &v) {
+  const u16 id = ctx.get(idx);
+  if (id != 0xffff && ctx.vbo[id] == v) return id;
+  const u16 n = ctx.vbo.size();
+  ctx.set(idx, n);
+  ctx.vbo.add(v);
+  return n;
+}
+
+static void buildfacemesh(brickmeshctx &ctx, vec3i xyz, vec3i idx) {
+  if (!ctx.s.visibleface(xyz, ctx.face)) return;
+
+  // build both triangles. the second one reuses two vertices of the first one
+  const int idx0 = 2*ctx.face+0, idx1 = 2*ctx.face+1;
+  const vec3i tris[] = {cubetris[idx0], cubetris[idx1]};
+  const vec3i corners[] = {vec3i(0,1,2), vec3i(0,2,3)};
+  const auto tex = ctx.s.get(xyz).tex[ctx.face];
+  loopi(2) { // build both triangles
+    gridvertex v[3]; // delay vertex creation for degenerated tris
+    vec3i locals[3];
+    loopj(3) { // build each vertex
+      locals[j] = idx+cubeiverts[tris[i][j]];
+      const vec2i lm = ctx.lmuv.get(idx,corners[i][j],ctx.face);
+      v[j] = makevertex(ctx.s, locals[j], ctx.face, lm);
+    }
+    const float mindist = float(gridvertex::unit)/512.f;
+    if (distance(vec3f(v[0].pos), vec3f(v[1].pos)) < mindist || // degenerated?
+        distance(vec3f(v[1].pos), vec3f(v[2].pos)) < mindist ||
+        distance(vec3f(v[2].pos), vec3f(v[0].pos)) < mindist)
+      continue;
+    loopj(3) {
+      ctx.ibo.add(addvertex(ctx, locals[j], v[j]));
+      ctx.tex.add(tex);
+    }
+  }
+}
+
+// merged faces are flat. a rectangle is just one quad
+static void buildrectmesh(brickmeshctx &ctx, const lightmapquad &q) {
+  const vec3i idx = q.xyz-ctx.s.org;
+  const vec4i quad = cubequads[q.face];
+  const vec3i u = (q.size.x-1)*quadu(q.face), v = (q.size.y-1)*quadv(q.face);
+  const vec3i cells[] = {idx, idx+v, idx+u+v, idx+u}; // cube holding each corner
+  u16 ids[4];
+  loopi(4) {
+    const vec3i local = cells[i]+cubeiverts[quad[i]];
+    const vec2i lm = ctx.lmuv.get(cells[i],i,q.face);
+    ids[i] = addvertex(ctx, local, makevertex(ctx.s, local, q.face, lm));
+  }
+  const vec3i corners[] = {vec3i(0,1,2), vec3i(0,2,3)};
+  const auto tex = ctx.s.get(q.xyz).tex[q.face];
+  loopi(2) loopj(3) {
+    ctx.ibo.add(ids[corners[i][j]]);
+    ctx.tex.add(tex);
+  }
+}
+
+static void radixsortibo(brickmeshctx &ctx) {
+  const s32 bitn=8, bucketn=1<<bitn, passn=2, mask=bucketn-1;
+  const auto len = ctx.ibo.size();
+  u16 histo[bucketn];
+  vector<u16> copytex(len), copyibo(len);
+  vector<u16> *pptex[] = {&ctx.tex, &copytex};
+  vector<u16> *ppibo[] = {&ctx.ibo, &copyibo};
+  loopi(passn) {
+    auto &fromtex = *pptex[i], &totex = *pptex[(i+1)%2];
+    auto &fromibo = *ppibo[i], &toibo = *ppibo[(i+1)%2];
+    u32 const shr = i*bitn;
+    MEMZERO(histo); // compute the histogram
+    loopj(len) histo[(fromtex[j]>>shr)&mask]++;
+    u32 pred = histo[0];
+    histo[0] = 0;
+    loopj(bucketn-1) {
+      const u32 next = histo[j+1];
+      histo[j+1] = histo[j] + pred;
+      pred = next;
+    }
+    loopj(len) { // sort using the histogram
+      const u32 k = histo[(fromtex[j]>>shr)&mask]++;
+      totex[k] = fromtex[j];
+      toibo[k] = fromibo[j];
+    }
+  }
+}
+
+static void buildgridmesh(const bricksnapshot &s, const lightmapuv &lmuv, brickbuild &out) {
+  brickmeshctx ctx(s, lmuv);
+  ctx.clear(0);
+  loopv(out.quads) {
+    const lightmapquad &q = out.quads[i];
+    if (s32(q.face) != ctx.face) ctx.clear(q.face);
+    if (q.size.x == 1 && q.size.y == 1)
+      buildfacemesh(ctx, q.xyz, q.xyz-s.org);
+    else
+      buildrectmesh(ctx, q);
+  }
+  if (ctx.vbo.size() == 0 || ctx.ibo.size() == 0) return;
+  ASSERT(ctx.vbo.size() <= maxgridvertices);
+  radixsortibo(ctx);
+
+  // one draw per texture
+  vector<vec2i> draws;
+  s32 n=1, tex=ctx.tex[0], len=ctx.ibo.size()-1;
+  loopi(len)
+    if (ctx.tex[i+1]!=tex) {
+      draws.add(vec2i(n,tex));
+      tex=ctx.tex[i+1];
+      n=1;
+    } else
+      ++n;
+  draws.add(vec2i(n,tex));
+
+  meshblob *blob = newmeshblob(ctx.vbo.size(), ctx.ibo.size(), draws.size());
+  loopv(ctx.vbo) blob->vertices()[i] = ctx.vbo[i];
+  memcpy(blob->indices(), &ctx.ibo[0], ctx.ibo.size()*sizeof(u16));
+  loopv(draws) blob->draws()[i] = draws[i];
+  out.mesh = blob;
+}
+
+// merged rectangles are flat. they are the occluders of the brick
+static void buildoccluders(brickbuild &out) {
+  loopv(out.quads) {
+    const lightmapquad &q = out.quads[i];
+    if (q.size.x*q.size.y < 2) continue;
+    const vec4i quad = cubequads[q.face];
+    const vec3i u = (q.size.x-1)*quadu(q.face), v = (q.size.y-1)*quadv(q.face);
+    const vec3f p0(q.xyz+cubeiverts[quad[0]]), p2(q.xyz+u+v+cubeiverts[quad[2]]);
+    out.occluders.add(aabb(min(p0,p2), max(p0,p2)));
+  }
+}
+
+void buildbrick(bricksnapshot &s, int lmres, bool greedy, brickbuild &out) {
+  buildfacemasks(s);
+  lightmapuv *lmuv = NEWE(lightmapuv); // too big for the stack of the threads
+  surfaceparamctx ctx(s, *lmuv, out.quads, lmres, greedy);
+  buildlmuv(ctx);
+  out.lmdim = lmuv->dim;
+  buildoccluders(out);
+  buildgridmesh(s, *lmuv, out);
+  SAFE_DELETE(lmuv);
+}
+
+/*-------------------------------------------------------------------------
+ - coarse meshes. vertices are welded per orientation and faces are sorted by
+ - texture to get one draw per texture
+ -------------------------------------------------------------------------*/
+struct lodface {
+  u16 tex;
+  u16 ids[4];
+};
+
+struct lodmeshctx {
+  INLINE lodmeshctx(void) { MEMSET(indices, 0xff); }
+  vector<gridvertex> vbo;
+  vector<lodface> faces;
+  u16 indices[6][lodcells+1][lodcells+1][lodcells+1];
+};
+
+static u16 addlodvertex(lodmeshctx &ctx, vec3i p, u32 face) {
+  u16 &id = ctx.indices[face][p.x][p.y][p.z];
+  if (id != 0xffff) return id;
+  const vec3i pos = gridvertex::unit*lodcell*p;
+  const int chan = face/2;
+  gridvertex v;
+  v.pos = vec3<s16>(pos.xzy());
+  v.pad = 0;
+  v.tex = vec2<s16>(chan==0?pos.yz():(chan==1?pos.xz():pos.xy()));
+  v.lm = vec2<u16>(lodshade(face));
+  id = ctx.vbo.size();
+  ctx.vbo.add(v);
+  return id;
+}
+
+meshblob *buildlod(const lodsnapshot &s) {
+  lodmeshctx *ctx = NEWE(lodmeshctx);
+  for (int x = 0; x < lodcells; ++x)
+  for (int y = 0; y < lodcells; ++y)
+  for (int z = 0; z < lodcells; ++z) {
+    const vec3i cell(x,y,z);
+    if (!s.solid(cell)) continue;
+    loopk(6) {
+      if (s.solid(cell+cubenorms[k])) continue;
+      const vec4i quad = cubequads[k];
+      lodface f;
+      f.tex = s.tex[x][y][z][k];
+      loopi(4) f.ids[i] = addlodvertex(*ctx, cell+cubeiverts[quad[i]], k);
+      ctx->faces.add(f);
+    }
+  }
+  meshblob *blob = NULL;
+  const s32 facenum = ctx->faces.size();
+  if (facenum != 0) {
+    quicksort(&ctx->faces[0], facenum, [](const lodface &f0, const lodface &f1) {
+      return f0.tex < f1.tex;
+    });
+    s32 drawnum = 1;
+    loopi(facenum-1) if (ctx->faces[i+1].tex != ctx->faces[i].tex) ++drawnum;
+    blob = newmeshblob(ctx->vbo.size(), 6*facenum, drawnum);
+    loopv(ctx->vbo) blob->vertices()[i] = ctx->vbo[i];
+    const vec3i corners[] = {vec3i(0,1,2), vec3i(0,2,3)};
+    u16 *indices = blob->indices();
+    vec2i *draws = blob->draws();
+    *draws = vec2i(0, ctx->faces[0].tex);
+    loopi(facenum) {
+      const lodface &f = ctx->faces[i];
+      if (f.tex != draws->y) *++draws = vec2i(0, f.tex);
+      loopj(2) loopk(3) *indices++ = f.ids[corners[j][k]];
+      draws->x += 6;
+    }
+  }
+  SAFE_DELETE(ctx);
+  return blob;
+}
+
+} // namespace world
+} // namespace cube
+
@@ -0,0 +1,173 @@
+#pragma once
+#include "world.hpp"
+
+namespace cube {
+namespace world {
+
+/*-------------------------------------------------------------------------
+ - cpu side of the brick build: surface parameterization and meshing. it only
+ - reads a snapshot of the brick. so, it runs in the task threads and never
+ - touches the world or opengl
+ -------------------------------------------------------------------------*/
+
+// copy of a brick and of its one cube border. the visible faces of the brick
+// cubes are computed from it once
+struct bricksnapshot {
+  static const int halo = 1;
+  static const int dim = lvl1+2*halo;
+  INLINE vec3i local(vec3i xyz) const {
+    const vec3i p = xyz-org+vec3i(halo);
+    ASSERT(all(p>=vec3i(zero)) && all(p<vec3i(dim)));
+    return p;
+  }
+  INLINE brickcube get(vec3i xyz) const {
+    const vec3i p = local(xyz);
+    return cubes[p.x][p.y][p.z];
+  }
+  INLINE void set(vec3i xyz, const brickcube &c) {
+    const vec3i p = local(xyz);
+    cubes[p.x][p.y][p.z] = c;
+  }
+  INLINE bool occupied(vec3i xyz) const { return get(xyz).mat!=EMPTY; }
+  INLINE u32 visiblefaces(vec3i xyz) const {
+    const vec3i p = xyz-org;
+    return faces[p.x][p.y][p.z];
+  }
+  INLINE bool visibleface(vec3i xyz, u32 face) const {
+    return (visiblefaces(xyz)>>face)&1;
+  }
+  INLINE vec3f getpos(vec3i xyz) const {return vec3f(xyz)+vec3f(get(xyz).p)/255.f;}
+  vec3i org; // world position of the brick
+  brickcube cubes[dim][dim][dim];
+  u8 faces[lvl1][lvl1][lvl1]; // same as lvl1grid::faces
+};
+
+// copy the brick at org and its border from the world
+void snapshot(bricksnapshot &s, vec3i org);
+// compute the visible faces of the brick cubes
+void buildfacemasks(bricksnapshot &s);
+
+// maximum light map width
+static const int maxlmw = 1024;
+
+// store UVs per cube and per face
+struct lightmapuv {
+  INLINE lightmapuv(void) : dim(zero) {MEMZERO(uv);}
+#if !defined(NDEBUG)
+  bool isinbound(vec3i idx, u32 corner, u32 face) const {
+    return all(idx>=vec3i(zero)) &&
+           all(idx<vec3i(lvl1)) &&
+           face<6 && corner<4;
+  }
+#endif // NDEBUG
+  INLINE void set(vec3i idx, vec2i v, u32 corner, u32 face) {
+    ASSERT(isinbound(idx, corner, face));
+    uv[face][idx.x][idx.y][idx.z][corner] = v;
+  }
+  INLINE vec2i get(vec3i idx, u32 corner, u32 face) const {
+    ASSERT(isinbound(idx, corner, face));
+    return uv[face][idx.x][idx.y][idx.z][corner];
+  }
+  vec2i uv[6][lvl1][lvl1][lvl1][4];
+  vec2i dim;
+};
+
+// visible faces to light and their location in the light map. undeformed
+// coplanar faces with the same texture are merged in one rectangle of faces
+// going along the u and v edges of the quad
+struct lightmapquad {
+  INLINE lightmapquad(void) {}
+  INLINE lightmapquad(vec3i xyz, vec2i uv, u32 face, vec2i size) :
+    xyz(xyz), uv(uv), size(size), face(face) {}
+  vec3i xyz; // global position of the cube holding the first corner
+  vec2i uv; // first texel of the quad
+  vec2i size; // number of faces along u (texel rows) and along v (columns)
+  u32 face;
+};
+
+// edges of the quad of the given face as cube offsets
+INLINE vec3i quadu(u32 face) {
+  const vec4i q = cubequads[face];
+  return cubeiverts[q[3]]-cubeiverts[q[0]];
+}
+INLINE vec3i quadv(u32 face) {
+  const vec4i q = cubequads[face];
+  return cubeiverts[q[1]]-cubeiverts[q[0]];
+}
+
+// packed vertex of the world mesh. positions (in opengl order) and texture
+// coordinates are fixed point values relative to the brick with the same unit
+// as the vertex displacements. light map coordinates are texel coordinates
+struct gridvertex {
+  static const int unit = 255;
+  vec3<s16> pos;
+  s16 pad;
+  vec2<s16> tex;
+  vec2<u16> lm;
+};
+INLINE bool operator== (const gridvertex &v0, const gridvertex &v1) {
+  return all(v0.pos==v1.pos) && all(v0.tex==v1.tex) && all(v0.lm==v1.lm);
+}
+
+// a face never outputs more than 4 vertices and a brick has less than
+// 3*lvl1*lvl1*(lvl1+1) faces. 16 bits indices are therefore always enough
+static const int maxgridvertices = 4*3*lvl1*lvl1*(lvl1+1);
+
+// vertices, indices and draws of a brick packed in one allocation
+struct meshblob {
+  INLINE gridvertex *vertices(void) { return (gridvertex*)(this+1); }
+  INLINE u16 *indices(void) { return (u16*)(vertices()+vertnum); }
+  INLINE vec2i *draws(void) { return (vec2i*)(indices()+indexnum+(indexnum&1)); }
+  u32 vertnum, indexnum, drawnum;
+};
+meshblob *newmeshblob(u32 vertnum, u32 indexnum, u32 drawnum);
+
+// everything the main thread needs to finish the brick
+struct brickbuild {
+  INLINE brickbuild(void) : lmdim(zero), mesh(NULL) {}
+  vector<lightmapquad> quads; // visible faces in light map order
+  vector<aabb> occluders; // merged rectangles of faces (world space)
+  vec2i lmdim; // light map dimension
+  meshblob *mesh; // null if there is nothing to draw
+};
+
+// compute the face masks, parameterize and mesh the brick with the given light
+// map resolution. if greedy is set, faces are merged as much as possible
+void buildbrick(bricksnapshot &s, int lmres, bool greedy, brickbuild &out);
+
+/*-------------------------------------------------------------------------
+ - coarse meshes of lvl2 nodes drawn far away. the node is resampled in cells
+ - of lodcell^3 cubes and every visible cell face becomes one quad. there is
+ - no light map: faces are lit by orientation with a tiny shade texture
+ -------------------------------------------------------------------------*/
+static const int lodcell = 4;
+static const int lodcells = lvlt2/lodcell;
+
+// cells of the node and of its one cell border. a cell is solid if at least a
+// quarter of its cubes are occupied. thin walls and floors are then kept
+struct lodsnapshot {
+  static const int halo = 1;
+  static const int dim = lodcells+2*halo;
+  INLINE bool solid(vec3i cell) const {
+    const vec3i p = cell+vec3i(halo);
+    return cells[p.x][p.y][p.z];
+  }
+  vec3i org; // world position of the node
+  bool cells[dim][dim][dim];
+  cubetex tex[lodcells][lodcells][lodcells]; // one texture per cell face
+};
+
+// resample the lvl2 node at org from the world. face masks must be up-to-date
+void snapshot(lodsnapshot &s, vec3i org);
+
+// light map coordinates of the shade texel used by the given face
+INLINE vec2i lodshade(u32 face) { return vec2i(2*face+1, 1); }
+static const int lodshadew = 12, lodshadeh = 2;
+static const vec2i lodshadedim(lodshadew, lodshadeh);
+
+// mesh the visible cell faces. positions are relative to the node
+meshblob *buildlod(const lodsnapshot &s);
+
+} // namespace world
+} // namespace cube
+
@@ -362,7 +362,7 @@ void destroy(intersector *bvhtree) {
 static const u32 waldmodulo[] = {1,2,0,1};
 
 template <bool occludedonly>
-INLINE bool raytriangle(const waldtriangle &tri, vec3f org, vec3f dir, hit *hit = NULL) {
+INLINE bool raytriangle(const waldtriangle &tri, vec3f org, vec3f dir, hit *hit = NULL, float tfar = FLT_MAX) {
   const u32 k = tri.k, ku = waldmodulo[k], kv = waldmodulo[k+1];
   const vec2f dirk(dir[ku], dir[kv]);
   const vec2f posk(org[ku], org[kv]);
@@ -370,7 +370,7 @@ INLINE bool raytriangle(const waldtriangle &tri, vec3f org, vec3f dir, hit *hit
   if (!occludedonly) {
     if (!((hit->t > t) & (t >= 0.f)))
       return false;
-  } else if (!(t >= 0.f))
+  } else if (!((t >= 0.f) & (t < tfar)))
     return false;
   const vec2f h = posk + t*dirk - tri.vertk;
   const float beta = dot(h,tri.bn), gamma = dot(h,tri.cn);
@@ -446,7 +446,7 @@ bool occluded(const intersector &bvhtree, const ray &r) {
         else if (flag == intersector::TRILEAF) {
           auto tris = node->getptr<waldtriangle>();
           const s32 n = tris->num;
-          loopi(n) if (raytriangle<true>(tris[i], r.org, r.dir)) return true;
+          loopi(n) if (raytriangle<true>(tris[i], r.org, r.dir, NULL, r.tfar)) return true;
         } else {
           node = node->getptr<intersector>()->root;
           goto processnode;
@@ -56,7 +56,11 @@ void clean(void) {
   }
 }
 
+// the simulation may print from a task thread while the hud is drawn
+static spinlock conlock;
+
 static void line(const char *sf, bool highlight) {
+  conlock.lock();
   cline cl;
   if (conlines.size()>100) {
     cl.cref = conlines.back().cref;
@@ -72,6 +76,7 @@ static void line(const char *sf, bool highlight) {
   } else
     strcpy_s(cl.cref, sf);
   puts(cl.cref);
+  conlock.unlock();
 #if defined(__WIN32__)
   fflush(stdout);
 #endif
@@ -92,13 +97,15 @@ void out(const char *s, ...) {
 
 void render(void) {
   int nd = 0;
-  char *refs[ndraw];
+  string refs[ndraw];
+  conlock.lock();
   loopv(conlines)
     if (conskip ? i>=conskip-1 || i>=conlines.size()-ndraw :
        game::lastmillis()-conlines[i].outtime<20000) {
-      refs[nd++] = conlines[i].cref;
+      strcpy_s(refs[nd++], conlines[i].cref);
       if (nd==ndraw) break;
     }
+  conlock.unlock();
   const int h = rr::FONTH;
   loopj(nd) rr::drawtext(refs[j], h/3, (h/4*5)*(nd-j-1)+h/3, 2);
 }
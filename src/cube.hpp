@@ -1,4 +1,5 @@
 #include "game.hpp"
+#include "asset.hpp"
 #include "client.hpp"
 #include "console.hpp"
 #include "demo.hpp"
@@ -308,10 +308,11 @@ static vec3i closercorner(vec3f p, vec3i xyz) {
  - editing itself
  -------------------------------------------------------------------------*/
 void cursorupdate(void) { // called every frame from hud
-  const auto r = mat3x3f::rotate(zaxis,game::player1->yaw)*
-                 mat3x3f::rotate(yaxis,game::player1->roll)*
-                 mat3x3f::rotate(-xaxis,game::player1->pitch);
-  const camera cam(game::player1->o, -r.vz, -r.vy, 90.f, 1.f);
+  const auto v = game::viewer();
+  const auto r = mat3x3f::rotate(zaxis,v->yaw)*
+                 mat3x3f::rotate(yaxis,v->roll)*
+                 mat3x3f::rotate(-xaxis,v->pitch);
+  const camera cam(v->o, -r.vz, -r.vy, 90.f, 1.f);
   const auto ray = cam.generate(2,2,1,1); // center of screen
   const auto res = world::castray(ray);
   anyundercursor = res.isec;
@@ -32,38 +32,54 @@ const char *entnames(int which) { return entnames_[which]; }
 
 static int triggertime = 0;
 
-void renderent(entity &e, const char *mdlname, float z, float yaw, int frame = 0, int numf = 1, int basetime = 0, float speed = 10.0f)
+void renderent(const entity &e, const char *mdlname, float z, float yaw, int frame = 0, int numf = 1, int basetime = 0, float speed = 10.0f)
 {
   rr::rendermodel(mdlname, frame, numf, 0, 1.1f, vec3f(e.x, z, e.y),
     yaw, 0, false, 1.0f, speed, 0, basetime);
 }
 
-void renderentities(void) {
+// entities as they were when the snapshot was taken. pickups change them
+// while the next frame is simulated
+static vector<entity> drawnents;
+static int drawntriggertime = 0;
+
+static bool drawable(const entity &e) {
+  if (e.type==MAPMODEL) return true;
+  if (e.type!=CARROT)
+    return (e.spawned || e.type==TELEPORT) && e.type>=I_SHELLS && e.type<=TELEPORT;
+  switch (e.attr2) {
+    case 0: case 2: return e.spawned;
+    case 4: case 5: return true;
+    default: return false;
+  }
+}
+
+void snapshotentities(void) {
   if (lastmillis()>triggertime+1000) triggertime = 0;
-  loopv(ents) {
-    entity &e = ents[i];
+  drawntriggertime = triggertime;
+  drawnents.clear();
+  loopv(ents) if (drawable(ents[i])) drawnents.add(ents[i]);
+}
+
+void renderentities(void) {
+  const int triggertime = drawntriggertime;
+  loopv(drawnents) {
+    const entity &e = drawnents[i];
     if (e.type==MAPMODEL) {
       mapmodelinfo &mmi = rr::getmminfo(e.attr2);
       if (!&mmi) continue;
       const vec3f pos(e.x, float(mmi.zoff+e.attr3), e.y);
       rr::rendermodel(mmi.name, 0, 1, e.attr4, (float)mmi.rad, pos,
-        (float)((e.attr1+7)-(e.attr1+7)%15), 0, false, 1.0f, 10.0f, mmi.snap);
-    } else {
-      if (e.type!=CARROT) {
-        if (!e.spawned && e.type!=TELEPORT) continue;
-        if (e.type<I_SHELLS || e.type>TELEPORT) continue;
-        renderent(e, entmdlnames[e.type-I_SHELLS], (float)(1+sin(float(lastmillis())/100.f+e.x+e.y)/20), lastmillis()/10.0f);
-      } else switch (e.attr2) {
-        case 1:
-        case 3: continue;
-        case 2:
-        case 0:
-          if (!e.spawned) continue;
-          renderent(e, "carrot", (float)(1+sin(lastmillis()/100.f+e.x+e.y)/20), lastmillis()/(e.attr2 ? 1.0f : 10.0f));
-        break;
-        case 4: renderent(e, "switch2", 3,      (float)e.attr3*90, (!e.spawned && !triggertime) ? 1  : 0, (e.spawned || !triggertime) ? 1 : 2,  triggertime, 1050.0f);  break;
-        case 5: renderent(e, "switch1", -0.15f, (float)e.attr3*90, (!e.spawned && !triggertime) ? 30 : 0, (e.spawned || !triggertime) ? 1 : 30, triggertime, 35.0f); break;
-      }
+        (float)((e.attr1+7)-(e.attr1+7)%15), 0, false, 1.0f, 10.0f, mmi.snap, 0, float(mmi.h));
+    } else if (e.type!=CARROT)
+      renderent(e, entmdlnames[e.type-I_SHELLS], (float)(1+sin(float(lastmillis())/100.f+e.x+e.y)/20), lastmillis()/10.0f);
+    else switch (e.attr2) {
+      case 2:
+      case 0:
+        renderent(e, "carrot", (float)(1+sin(lastmillis()/100.f+e.x+e.y)/20), lastmillis()/(e.attr2 ? 1.0f : 10.0f));
+      break;
+      case 4: renderent(e, "switch2", 3,      (float)e.attr3*90, (!e.spawned && !triggertime) ? 1  : 0, (e.spawned || !triggertime) ? 1 : 2,  triggertime, 1050.0f);  break;
+      case 5: renderent(e, "switch1", -0.15f, (float)e.attr3*90, (!e.spawned && !triggertime) ? 30 : 0, (e.spawned || !triggertime) ? 1 : 30, triggertime, 35.0f); break;
     }
   }
 };
@@ -95,6 +95,9 @@ void putitems(u8 *&p);
 void checkquad(int time);
 void checkitems(void);
 void realpickup(int n, dynent *d);
+// copy the entities to draw in the render snapshot
+void snapshotentities(void);
+// render the entities of the snapshot
 void renderentities(void);
 void resetspawns(void);
 void setspawn(u32 i, bool on);
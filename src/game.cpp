@@ -214,46 +214,100 @@ static void sleepf(char *msec, char *cmd) {
 }
 COMMANDN(sleep, sleepf, ARG_2STR);
 
-void updateworld(int millis) {
-  if (lastmillis()) {
-    setcurtime(millis - lastmillis());
-    if (sleepwait && lastmillis()>sleepwait) {
-      sleepwait = 0;
-      cmd::execute(sleepcmd);
-    }
-    physics::physicsframe();
-    checkquad(curtime());
-    if (m_arena)
-      arenarespawn();
-    moveprojectiles(float(curtime()));
-    demo::playbackstep();
-    if (!demo::playing()) {
-      if (client::getclientnum()>=0)
-        shoot(player1, worldpos_); // only shoot when connected to server
-      // do this first, so we have most accurate information when our player
-      // moves
-      client::gets2c();
-    }
-    otherplayers();
-    if (!demo::playing()) {
-      monsterthink();
-      if (player1->state==CS_DEAD) {
-        if (lastmillis()-player1->lastaction<2000) {
-          player1->move = player1->strafe = 0;
-          physics::moveplayer(player1, 10, false);
-        } else if (!m_arena && !m_sp && lastmillis()-player1->lastaction>10000)
-          respawn();
-      } else if (!intermission) {
-        physics::moveplayer(player1, 20, true);
-        checkitems();
+void beginupdate(int millis) {
+  if (!lastmillis()) return;
+  setcurtime(millis - lastmillis());
+  if (sleepwait && lastmillis()>sleepwait) {
+    sleepwait = 0;
+    cmd::execute(sleepcmd);
+  }
+  if (m_arena)
+    arenarespawn();
+  demo::playbackstep();
+  // do this first, so we have most accurate information when our player
+  // moves
+  if (!demo::playing())
+    client::gets2c();
+}
+
+void simulate(const vec3f &target) {
+  if (!lastmillis()) return;
+  physics::physicsframe();
+  checkquad(curtime());
+  moveprojectiles(float(curtime()));
+  if (!demo::playing() && client::getclientnum()>=0)
+    shoot(player1, target); // only shoot when connected to server
+  otherplayers();
+  if (!demo::playing()) {
+    monsterthink();
+    if (player1->state==CS_DEAD) {
+      if (lastmillis()-player1->lastaction<2000) {
+        player1->move = player1->strafe = 0;
+        physics::moveplayer(player1, 10, false);
       }
-      // do this last, to reduce the effective frame lag
-      client::c2sinfo(player1);
-    }
+    } else if (!intermission)
+      physics::moveplayer(player1, 20, true);
+  }
+  rr::updateparticles(curtime());
+  rr::updatespheres(curtime());
+}
+
+void endupdate(int millis) {
+  if (lastmillis() && !demo::playing()) {
+    checkspend();
+    if (player1->state==CS_DEAD) {
+      if (!m_arena && !m_sp && lastmillis()-player1->lastaction>10000)
+        respawn();
+    } else if (!intermission)
+      checkitems();
+    // do this last, to reduce the effective frame lag
+    client::c2sinfo(player1);
   }
   setlastmillis(millis);
 }
 
+void updateworld(int millis) {
+  beginupdate(millis);
+  simulate(worldpos());
+  endupdate(millis);
+}
+
+/*--------------------------------------------------------------------------
+ - render snapshot. the renderer only sees copies of the entities, particles
+ - and spheres. so the next frame may be simulated while this one is drawn
+ -------------------------------------------------------------------------*/
+static dynent viewer_;
+static vector<drawnclient> drawnplayers;
+
+const dynent *viewer(void) { return &viewer_; }
+
+void snapshotclient(vector<drawnclient> &v, const dynent *d, bool team,
+                    const char *mdlname, bool hellpig, float scale)
+{
+  drawnclient &c = v.add();
+  c.d = *d;
+  c.key = uintptr(d);
+  c.mdlname = mdlname;
+  c.scale = scale;
+  c.team = team;
+  c.hellpig = hellpig;
+}
+
+void takesnapshot(void) {
+  viewer_ = *player1;
+  drawnplayers.clear();
+  loopv(players) {
+    const dynent *d = players[i];
+    if (d && (!demo::playing() || i!=demo::clientnum()))
+      snapshotclient(drawnplayers, d, isteam(player1->team, d->team), "monster/ogro", false, 1.f);
+  }
+  snapshotmonsters();
+  snapshotentities();
+  snapshotscores();
+  rr::snapshotparticles();
+  rr::snapshotspheres();
+}
+
 void entinmap(dynent *d) {
   loopi(100) { // try max 100 times
     float dx = (rnd(21)-10)/10.0f*i;  // increasing distance
@@ -433,11 +487,14 @@ void startmap(const char *name) {
 static const int frame[] = {178, 184, 190, 137, 183, 189, 197, 164, 46, 51, 54, 32, 0,  0, 40, 1,  162, 162, 67, 168};
 static const int range[] = {6,   6,   8,   28,  1,   1,   1,   1,   8,  19, 4,  18, 40, 1, 6,  15, 1,   1,   1,  1  };
 
-void renderclient(dynent *d, bool team, const char *mdlname, bool hellpig, float scale) {
+void renderclient(const drawnclient &c) {
+  const dynent *d = &c.d;
+  const bool hellpig = c.hellpig;
+  float scale = c.scale;
   int n = 3;
   float speed = 100.0f;
   float mz = d->o.z-d->eyeheight+1.55f*scale;
-  int cast = (int) (uintptr_t) d;
+  int cast = (int) c.key;
   int basetime = -(((int)cast)&0xFFF);
   if (d->state==CS_DEAD) {
     int r;
@@ -475,35 +532,30 @@ void renderclient(dynent *d, bool team, const char *mdlname, bool hellpig, float
     scale *= 32;
     mz -= 1.9f;
   }
-  rr::rendermodel(mdlname, frame[n], range[n], 0, 1.5f, vec3f(d->o.x, mz, d->o.y),
-    d->yaw+90.f, d->pitch/2, team, scale, speed, 0, basetime);
+  rr::rendermodel(c.mdlname, frame[n], range[n], 0, 1.5f, vec3f(d->o.x, mz, d->o.y),
+    d->yaw+90.f, d->pitch/2, c.team, scale, speed, 0, basetime);
 }
 
-void renderclients(void) {
-  dynent *d;
-  loopv(players)
-    if ((d = players[i]) && (!demo::playing() || i!=demo::clientnum()))
-      renderclient(d, isteam(player1->team, d->team), "monster/ogro", false, 1.f);
-}
+void renderclients(void) { loopv(drawnplayers) renderclient(drawnplayers[i]); }
 
 struct sline { string s; };
 static vector<sline> scorelines;
 
-static void renderscore(dynent *d) {
+static void snapshotscore(const dynent *d) {
   sprintf_sd(lag)("%d", d->plag);
   sprintf_sd(name) ("(%s)", d->name);
   sprintf_s(scorelines.add().s)("%d\t%s\t%d\t%s\t%s",
             d->frags, d->state==CS_LAGGED ? "LAG" : lag,
             d->ping, d->team, d->state==CS_DEAD ? name : d->name);
-  menu::manual(0, scorelines.size()-1, scorelines.back().s);
 }
 
 static const int maxteams = 4;
-static char *teamname[maxteams];
+static const char *teamname[maxteams];
 static int teamscore[maxteams], teamsused;
 static string teamscores;
+static bool drawnteams = false;
 
-static void addteamscore(dynent *d) {
+static void addteamscore(const dynent *d) {
   if (!d) return;
   loopi(teamsused) if (strcmp(teamname[i], d->team)==0) {
     teamscore[i] += d->frags;
@@ -514,14 +566,17 @@ static void addteamscore(dynent *d) {
   teamscore[teamsused++] = d->frags;
 }
 
-void renderscores(void) {
-  if (!scoreson) return;
+// the score lines are built from the clients when the snapshot is taken since
+// players join, leave and score while the next frame is simulated
+void snapshotscores(void) {
   scorelines.resize(0);
-  if (!demo::playing()) renderscore(player1);
+  drawnteams = false;
+  if (!scoreson) return;
+  if (!demo::playing()) snapshotscore(player1);
   loopv(players) if (players[i])
-    renderscore(players[i]);
-  menu::sort(0, scorelines.size());
+    snapshotscore(players[i]);
   if (m_teammode) {
+    drawnteams = true;
     teamsused = 0;
     loopv(players)
       addteamscore(players[i]);
@@ -531,6 +586,14 @@ void renderscores(void) {
       sprintf_sd(sc)("[ %s: %d ]", teamname[j], teamscore[j]);
       strcat_s(teamscores, sc);
     }
+  }
+}
+
+void renderscores(void) {
+  if (!scoreson) return;
+  loopv(scorelines) menu::manual(0, i, scorelines[i].s);
+  menu::sort(0, scorelines.size());
+  if (drawnteams) {
     menu::manual(0, scorelines.size(), (char*) "");
     menu::manual(0, scorelines.size()+1, teamscores);
   }
@@ -29,6 +29,18 @@ GLOBAL_VAR_DECL(curtime,int);
 void mousemove(int dx, int dy); 
 // main game update loop
 void updateworld(int millis);
+// the same update in three steps. only simulate may run on a task thread:
+// physics, projectiles, monsters and particles. the main thread handles
+// scripts, demos and the network before and items and respawn after it.
+// target is where the player shoots
+void beginupdate(int millis);
+void simulate(const vec3f &target);
+void endupdate(int millis);
+// copy the players, monsters, particles and spheres for the renderer.
+// projectiles are drawn with their particles
+void takesnapshot(void);
+// player1 when the snapshot was taken. camera and hud use it
+const dynent *viewer(void);
 // create a new client
 void initclient(void);
 // place at random spawn. also used by monsters
@@ -55,11 +67,24 @@ void fixplayer1range(void);
 void entinmap(dynent *d);
 // called just after a map load
 void startmap(const char *name);
-// render all the clients
+// player or monster as copied in the snapshot
+struct drawnclient {
+  dynent d;
+  uintptr key; // address of the live entity. it seeds the animations
+  const char *mdlname;
+  float scale;
+  bool team, hellpig;
+};
+// add a copy of the entity to the snapshot
+void snapshotclient(vector<drawnclient> &v, const dynent *d, bool team,
+                    const char *mdlname, bool hellpig, float scale);
+// render all the clients of the snapshot
 void renderclients(void);
 // render the client
-void renderclient(dynent *d, bool team, const char *name, bool hellpig, float scale);
-// render the score on screen
+void renderclient(const drawnclient &c);
+// copy the score lines in the render snapshot
+void snapshotscores(void);
+// render the score of the snapshot on screen
 void renderscores(void);
 // release memory used by all entities
 void cleanentities(void);
@@ -2,6 +2,10 @@
 #include <SDL/SDL.h>
 #include <enet/enet.h>
 #include <time.h>
+#if !defined(__WIN32__)
+#include <unistd.h>
+#endif // __WIN32__
+#include "base/task.hpp"
 
 #if !defined(__JAVASCRIPT__)
 #include <xmmintrin.h>
@@ -16,6 +20,7 @@ void cleanup(char *msg) { // single program exit point;
     demo::stop();
     client::disconnect(true);
     cmd::writecfg();
+    asset::clean();
     game::clean();
     rr::clean();
     world::clean();
@@ -25,6 +30,7 @@ void cleanup(char *msg) { // single program exit point;
     menu::clean();
     cmd::clean();
     ogl::clean();
+    tasking::clean();
     SDL_ShowCursor(1);
     if (msg) {
 #if defined(__WIN32__)
@@ -76,6 +82,26 @@ void screenshot(void) {
 COMMAND(screenshot, ARG_NONE);
 COMMAND(quit, ARG_NONE);
 
+// "tasktrace 1", play, "tasktrace 0" and "dumptasktrace file.json". then open
+// the file in chrome://tracing
+static void tasktrace(int on) {
+  if (on)
+    tasking::starttrace();
+  else
+    tasking::stoptrace();
+}
+static void dumptasktrace(const char *name) {
+  string filename;
+  strcpy_s(filename, name);
+  const s32 n = tasking::dumptrace(path(filename));
+  if (n < 0)
+    console::out("unable to write %s", name);
+  else
+    console::out("%d task events written in %s", n, name);
+}
+COMMAND(tasktrace, ARG_1INT);
+COMMAND(dumptasktrace, ARG_1STR);
+
 void keyrepeat(bool on) {
   SDL_EnableKeyRepeat(on ? SDL_DEFAULT_REPEAT_DELAY : 0, SDL_DEFAULT_REPEAT_INTERVAL);
 }
@@ -86,6 +112,71 @@ VARF(grabmouse, 0, 0, 1, {SDL_WM_GrabInput(grabmouse ? SDL_GRAB_ON : SDL_GRAB_OF
 
 int ignore = 5;
 
+// one task thread per core but the main thread one
+static u32 cpunum(void) {
+#if defined(__WIN32__)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return max(u32(info.dwNumberOfProcessors), 1u);
+#elif defined(__JAVASCRIPT__)
+  return 1;
+#else
+  return max(u32(sysconf(_SC_NPROCESSORS_ONLN)), 1u);
+#endif // __WIN32__
+}
+
+// task threads (0 for one per core but the main thread). pending assets are
+// finished before the threads are restarted
+static void restarttasking(void);
+VARFP(taskthreads, 0, 0, 64, restarttasking());
+static u32 taskthreadnum(void) { return taskthreads ? u32(taskthreads) : cpunum()-1; }
+static void restarttasking(void) {
+  const u32 threadnum = taskthreadnum();
+  if (threadnum == tasking::threadnum()) return;
+  asset::flush();
+  tasking::clean();
+  tasking::init(&threadnum, 1);
+}
+
+// idle task threads spin "taskspin" times, yield "taskyield" times and sleep
+static void settaskidle(void);
+VARFP(taskspin, 0, 2000, 1000000, settaskidle());
+VARFP(taskyield, 0, 16, 1000000, settaskidle());
+static void settaskidle(void) { tasking::setidle(taskspin, taskyield); }
+
+static void taskstats(void) {
+  const tasking::idlestats stats = tasking::getidlestats();
+  const u32 parked = max(stats.parkwakes, 1u);
+  console::out("%d threads: %u spin, %u yield, %u park wake-ups",
+    tasking::threadnum(), stats.spinwakes, stats.yieldwakes, stats.parkwakes);
+  console::out("park wake latency: %u us (mean), %u us (max)",
+    u32(stats.wakeusec/parked), u32(stats.maxwakeusec));
+  tasking::resetidlestats();
+}
+COMMAND(taskstats, ARG_NONE);
+
+// simulate the next frame on a task thread while the snapshot of the current
+// one is rendered. it costs one frame of latency
+VARP(pipeline, 0, 1, 1);
+
+struct simulatetask : public task {
+  INLINE simulatetask(const vec3f &target) :
+    task("simulate", 1, 1, 0, task::HI_PRIO), target(target) {}
+  virtual void run(u32 elt) { game::simulate(target); }
+  vec3f target;
+};
+
+// -b<frames>: once the map is loaded, run cpubench at the screen resolution
+// and quit. with the __GLRECORD__ build no opengl context is created so it
+// also runs headless (SDL_VIDEODRIVER=dummy)
+static int benchframes = 0;
+static void runbench(void) {
+  asset::flush();
+  sprintf_sd(bench)("cpubench %d %d %d", benchframes, scr_w, scr_h);
+  cmd::execute(bench);
+  quit();
+}
+
 static void main_loop(void) {
   int millis = SDL_GetTicks()*gamespeed/100;
   if (millis-game::lastmillis()>200) game::setlastmillis(millis-200);
@@ -94,15 +185,35 @@ static void main_loop(void) {
   if (millis-game::lastmillis()<minmillis)
     SDL_Delay(minmillis-(millis-game::lastmillis()));
 #endif // __JAVASCRIPT__
-  game::updateworld(millis);
-  if (!demo::playing())
-    server::slice((int)time(NULL), 0);
+  const bool pipelined = pipeline && tasking::threadnum() != 0;
+  ref<task> simulation;
+  if (pipelined) {
+    game::takesnapshot();
+    game::beginupdate(millis);
+    ogl::buildworld();
+    simulation = NEW(simulatetask, game::worldpos());
+    simulation->scheduled();
+  } else {
+    game::updateworld(millis);
+    ogl::buildworld();
+    game::takesnapshot();
+  }
   static float fps = 30.0f;
   fps = (1000.0f/game::curtime()+fps*50)/51;
   rr::readdepth(scr_w, scr_h);
+#if !defined(__GLRECORD__)
   SDL_GL_SwapBuffers();
-  sound::updatevol();
+#endif // __GLRECORD__
+  asset::update();
   ogl::drawframe(scr_w, scr_h, fps);
+  if (pipelined) {
+    simulation->wait();
+    game::endupdate(millis);
+  }
+  if (!demo::playing())
+    server::slice((int)time(NULL), 0);
+  sound::updatevol();
+  if (benchframes > 0) runbench();
   SDL_Event event;
   int lasttype = 0, lastbut = 0;
   while (SDL_PollEvent(&event)) {
@@ -171,6 +282,7 @@ static int main(int argc, char **argv) {
       case 'm': master = a; break;
       case 'p': passwd = a; break;
       case 'c': maxcl  = atoi(a); break;
+      case 'b': benchframes = max(atoi(a), 1); fs = 0; break;
       default:  console::out("unknown commandline option");
     } else
       console::out("unknown commandline argument");
@@ -194,6 +306,11 @@ static int main(int argc, char **argv) {
   game::initclient();
   server::init(dedicated, uprate, sdesc, ip, master, passwd, maxcl);  // never returns if dedicated
 
+  log("tasking");
+  const u32 threadnum = taskthreadnum();
+  tasking::init(&threadnum, 1);
+  settaskidle();
+
   log("world");
   // world::empty(7, true);
 
@@ -202,8 +319,13 @@ static int main(int argc, char **argv) {
   SDL_WM_GrabInput(grabmouse ? SDL_GRAB_ON : SDL_GRAB_OFF);
 
   log("video: mode");
+#if defined(__GLRECORD__)
+  // no opengl context is needed by the recorder (SDL_VIDEODRIVER=dummy works)
+  if (SDL_SetVideoMode(scr_w, scr_h, 0, fs)==NULL) fatal("Unable to create screen");
+#else
   SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
   if (SDL_SetVideoMode(scr_w, scr_h, 0, SDL_OPENGL|fs)==NULL) fatal("Unable to create OpenGL screen");
+#endif // __GLRECORD__
 
   log("video: misc");
   SDL_WM_SetCaption("cube engine", NULL);
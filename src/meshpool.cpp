@@ -0,0 +1,160 @@
+#include "meshpool.hpp"
+#include "ogl.hpp"
+
+namespace cube {
+namespace world {
+
+static vector<meshpool*> pools;
+static vector<meshslot> slottable; // slot 0 is the null slot
+static vector<u32> freeslots;
+
+meshpool::meshpool(void) :
+  vertused(0), indexused(0), vertlive(0), indexlive(0),
+  dirtyvert(zero), dirtyindex(zero), vbo(0), ibo(0)
+{
+  vertices = (gridvertex*) MALLOC(poolvertices*sizeof(gridvertex));
+  indices = (u16*) MALLOC(poolindices*sizeof(u16));
+}
+
+meshpool::~meshpool(void) {
+  if (vbo) ogl::deletebuffers(1, &vbo);
+  if (ibo) ogl::deletebuffers(1, &ibo);
+  FREE(vertices);
+  FREE(indices);
+}
+
+static void setdirty(vec2i &r, u32 first, u32 last) {
+  if (first >= last) return;
+  if (r.x >= r.y)
+    r = vec2i(first, last);
+  else
+    r = vec2i(min(r.x, s32(first)), max(r.y, s32(last)));
+}
+
+static void compact(meshpool &p) {
+  quicksort(p.slots.begin(), p.slots.end(), [](u32 s0, u32 s1) {
+    return slottable[s0].firstvert < slottable[s1].firstvert;
+  });
+  u32 vert = 0, index = 0;
+  loopv(p.slots) {
+    meshslot &s = slottable[p.slots[i]];
+    if (s.firstindex != index) {
+      memmove(p.indices+index, p.indices+s.firstindex, s.indexnum*sizeof(u16));
+      setdirty(p.dirtyindex, index, index+s.indexnum);
+      s.firstindex = index;
+    }
+    if (s.firstvert != vert) {
+      const u16 delta = s.firstvert-vert;
+      memmove((void*)(p.vertices+vert), p.vertices+s.firstvert, s.vertnum*sizeof(gridvertex));
+      setdirty(p.dirtyvert, vert, vert+s.vertnum);
+      loopj(s32(s.indexnum)) p.indices[index+j] -= delta;
+      setdirty(p.dirtyindex, index, index+s.indexnum);
+      s.firstvert = vert;
+    }
+    vert += s.vertnum;
+    index += s.indexnum;
+  }
+  ASSERT(vert == p.vertlive && index == p.indexlive);
+  p.vertused = vert;
+  p.indexused = index;
+}
+
+// first pool with enough room at its end, then the first one with enough
+// room once compacted and finally a new one
+static u32 findpool(u32 vertnum, u32 indexnum) {
+  loopv(pools) if (pools[i]->fits(vertnum, indexnum)) return i;
+  loopv(pools) {
+    meshpool &p = *pools[i];
+    if (p.vertlive+vertnum > poolvertices || p.indexlive+indexnum > poolindices)
+      continue;
+    compact(p);
+    return i;
+  }
+  pools.add(NEWE(meshpool));
+  return pools.size()-1;
+}
+
+u32 allocmesh(meshblob &m) {
+  if (m.vertnum > poolvertices || m.indexnum > poolindices)
+    fatal("mesh is too large for the mesh pools");
+  const u32 poolidx = findpool(m.vertnum, m.indexnum);
+  meshpool &p = *pools[poolidx];
+  meshslot s;
+  s.pool = poolidx;
+  s.firstvert = p.vertused;
+  s.vertnum = m.vertnum;
+  s.firstindex = p.indexused;
+  s.indexnum = m.indexnum;
+  memcpy((void*)(p.vertices+s.firstvert), m.vertices(), s.vertnum*sizeof(gridvertex));
+  loopi(s32(s.indexnum)) p.indices[s.firstindex+i] = m.indices()[i]+s.firstvert;
+  setdirty(p.dirtyvert, s.firstvert, s.firstvert+s.vertnum);
+  setdirty(p.dirtyindex, s.firstindex, s.firstindex+s.indexnum);
+  p.vertused += s.vertnum;
+  p.indexused += s.indexnum;
+  p.vertlive += s.vertnum;
+  p.indexlive += s.indexnum;
+
+  u32 slot;
+  if (slottable.size() == 0) slottable.add(meshslot());
+  if (freeslots.size() != 0) {
+    slot = freeslots.back();
+    freeslots.pop_back();
+    slottable[slot] = s;
+  } else {
+    slot = slottable.size();
+    slottable.add(s);
+  }
+  p.slots.add(slot);
+  return slot;
+}
+
+void freemesh(u32 slot) {
+  if (slot == 0 || slot >= u32(slottable.size())) return;
+  const meshslot &s = slottable[slot];
+  if (s.pool >= u32(pools.size())) return;
+  meshpool &p = *pools[s.pool];
+  loopv(p.slots) if (p.slots[i] == slot) {
+    p.slots[i] = p.slots.back();
+    p.slots.pop_back();
+    break;
+  }
+  p.vertlive -= s.vertnum;
+  p.indexlive -= s.indexnum;
+  if (p.slots.size() == 0) p.vertused = p.indexused = 0;
+  slottable[slot].pool = ~0u;
+  freeslots.add(slot);
+}
+
+const meshslot &getmeshslot(u32 slot) {
+  ASSERT(slot != 0 && slot < u32(slottable.size()));
+  return slottable[slot];
+}
+
+u32 compactmeshpools(float maxwaste) {
+  u32 n = 0;
+  loopv(pools) {
+    meshpool &p = *pools[i];
+    if (p.waste() == 0 || float(p.waste()) <= maxwaste*float(p.vertused)) continue;
+    compact(p);
+    ++n;
+  }
+  return n;
+}
+
+u32 meshpoolnum(void) { return pools.size(); }
+meshpool &getmeshpool(u32 idx) { return *pools[idx]; }
+
+void cleanmeshpool(meshpool &p) {
+  p.dirtyvert = p.dirtyindex = vec2i(zero);
+}
+
+void destroymeshpools(void) {
+  loopv(pools) SAFE_DELETE(pools[i]);
+  pools.reset();
+  slottable.reset();
+  freeslots.reset();
+}
+
+} // namespace world
+} // namespace cube
+
@@ -0,0 +1,60 @@
+#pragma once
+#include "brickmesh.hpp"
+
+namespace cube {
+namespace world {
+
+/*-------------------------------------------------------------------------
+ - brick and node meshes are suballocated in a few big shared buffers. pools
+ - are small enough for 16 bits indices. so, indices are rebased to be
+ - absolute in the pool and a pool is drawn with one buffer and attribute
+ - setup. a pool keeps a cpu copy of its buffers. meshes freed by rebuilds
+ - leave holes that compaction removes by moving the live meshes to the front
+ - of the pool. opengl buffers are refreshed by the renderer from the copy
+ -------------------------------------------------------------------------*/
+static const u32 poolvertices = 1u<<16;
+static const u32 poolindices = 1u<<17;
+static_assert(u32(maxgridvertices)<=poolvertices, "a brick must fit in a pool");
+static_assert(u32(maxgridvertices)/4*6<=poolindices, "a brick must fit in a pool");
+
+// where a mesh lives in its pool
+struct meshslot {
+  u32 pool, firstvert, vertnum, firstindex, indexnum;
+};
+
+struct meshpool : noncopyable {
+  meshpool(void);
+  ~meshpool(void);
+  INLINE bool fits(u32 v, u32 i) const {
+    return vertused+v <= poolvertices && indexused+i <= poolindices;
+  }
+  INLINE u32 waste(void) const { return vertused-vertlive; }
+  gridvertex *vertices; // cpu copy of the vertex buffer
+  u16 *indices; // cpu copy of the index buffer
+  u32 vertused, indexused; // end of the allocated parts
+  u32 vertlive, indexlive; // part of them still used
+  vec2i dirtyvert, dirtyindex; // ranges to upload. empty if x >= y
+  u32 vbo, ibo; // ogl handles. created by the renderer
+  vector<u32> slots; // live meshes allocated here
+};
+
+// copy the mesh in a pool. return its slot (never 0)
+u32 allocmesh(meshblob &m);
+// release the slot. null slot is ignored
+void freemesh(u32 slot);
+const meshslot &getmeshslot(u32 slot);
+
+// move the live meshes to the front of the pools wasting more than maxwaste
+// of their allocated vertices. return the number of compacted pools
+u32 compactmeshpools(float maxwaste);
+
+u32 meshpoolnum(void);
+meshpool &getmeshpool(u32 idx);
+// mark the dirty ranges as uploaded
+void cleanmeshpool(meshpool &p);
+// free the pools and their ogl buffers. all slots must be released
+void destroymeshpools(void);
+
+} // namespace world
+} // namespace cube
+
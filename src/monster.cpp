@@ -104,10 +104,12 @@ void monsterclear(void) {
   }
 }
 
-bool enemylos(dynent *m, vec3f &v) {
-  // no occlusion, return the target itself
+// lines of sight of all monsters are traced at once in monsterthink
+static world::raybatch losbatch;
+
+bool enemylos(dynent *m, u32 los, vec3f &v) {
   v = m->enemy->o;
-  return true;
+  return !losbatch.occluded(los);
 }
 
 // monster AI is sequenced using transitions: they are in a particular state
@@ -130,7 +132,7 @@ void normalise(dynent *m, float angle) {
 }
 
 // main AI thinking routine, called every frame for every monster
-void monsteraction(dynent *m) {
+void monsteraction(dynent *m, u32 los) {
   if (m->enemy->state==CS_DEAD) {
     m->enemy = player1;
     m->anger = 0;
@@ -168,7 +170,7 @@ void monsteraction(dynent *m) {
     break;
     case M_SLEEP: { // state classic sp monster start in, wait for visual contact
       vec3f target;
-      if (edit::mode() || !enemylos(m, target)) return; // skip running physics
+      if (edit::mode() || !enemylos(m, los, target)) return; // skip running physics
       normalise(m, enemyyaw);
       const auto angle = abs(enemyyaw-m->yaw);
       if (disttoenemy<8                // the better the angle to the player
@@ -195,7 +197,7 @@ void monsteraction(dynent *m) {
       m->targetyaw = enemyyaw;
       if (m->trigger<lastmillis()) {
         vec3f target;
-        if (!enemylos(m, target)) // no visual contact anymore, let monster get as close as possible then search for player
+        if (!enemylos(m, los, target)) // no visual contact anymore, let monster get as close as possible then search for player
           transition(m, M_HOME, 1, 800, 500);
         else  { // the closer the monster is the more likely he wants to shoot
           if (!rnd((int)disttoenemy/3+1) && m->enemy->state==CS_ALIVE) { // get ready to fire
@@ -242,6 +244,11 @@ void endsp(bool allkilled) {
   server::startintermission();
 }
 
+void checkspend(void) {
+  if (monstertotal && !spawnremain && numkilled==monstertotal)
+    endsp(true);
+}
+
 void monsterthink(void) {
   if (m_dmsp && spawnremain && lastmillis()>nextmonster) {
     if (spawnremain--==monstertotal)
@@ -250,9 +257,6 @@ void monsterthink(void) {
     spawnmonster();
   }
 
-  if (monstertotal && !spawnremain && numkilled==monstertotal)
-    endsp(true);
-
   loopv(ents) { // equivalent of player entity touch, but only teleports are used
     entity &e = ents[i];
     if (e.type!=TELEPORT) continue;
@@ -270,15 +274,29 @@ void monsterthink(void) {
     }
   }
 
+  losbatch.clear();
+  loopv(monsters) {
+    const dynent *m = monsters[i];
+    const dynent *e = m->enemy->state==CS_DEAD ? player1 : m->enemy;
+    losbatch.add(m->o, e->o);
+  }
+  losbatch.trace();
   loopv(monsters) if (monsters[i]->state==CS_ALIVE)
-    monsteraction(monsters[i]);
+    monsteraction(monsters[i], i);
 }
 
-void monsterrender(void) {
-  loopv(monsters)
-    renderclient(monsters[i], false, monstertypes[monsters[i]->mtype].mdlname, monsters[i]->mtype==5, monstertypes[monsters[i]->mtype].mscale/10.0f);
+static vector<drawnclient> drawnmonsters;
+
+void snapshotmonsters(void) {
+  drawnmonsters.clear();
+  loopv(monsters) {
+    const monstertype &t = monstertypes[monsters[i]->mtype];
+    snapshotclient(drawnmonsters, monsters[i], false, t.mdlname, monsters[i]->mtype==5, t.mscale/10.0f);
+  }
 }
 
+void monsterrender(void) { loopv(drawnmonsters) renderclient(drawnmonsters[i]); }
+
 } // namespace game
 } // namespace cube
 
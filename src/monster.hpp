@@ -8,6 +8,9 @@ enum {M_NONE, M_SEARCH, M_HOME, M_ATTACKING, M_PAIN, M_SLEEP, M_AIMING};
 void monsterclear(void);
 void restoremonsterstate(void);
 void monsterthink(void);
+// end the single player game once all the monsters are dead
+void checkspend(void);
+void snapshotmonsters(void);
 void monsterrender(void);
 dvector &getmonsters(void);
 void monsterpain(dynent *m, int damage, dynent *d);
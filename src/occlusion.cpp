@@ -0,0 +1,181 @@
+#include "world.hpp"
+#include <cfloat>
+#include <cmath>
+#if !defined(__JAVASCRIPT__)
+#include <xmmintrin.h>
+#endif // __JAVASCRIPT__
+
+namespace cube {
+namespace world {
+
+/*-------------------------------------------------------------------------
+ - software occlusion culling. flat rectangles of faces are rasterized in a
+ - coarse depth buffer. a pixel only gets a depth if it is fully covered by
+ - the rectangle and the depth is the farthest one in the pixel. boxes are then
+ - tested with their closest depth. so, we never cull anything visible
+ -------------------------------------------------------------------------*/
+static const int occw = 256, occh = 128;
+static float DEFAULT_ALIGNED depth[occh][occw]; // ndc z
+static mat4x4f occmvp(one);
+static float occminarea = 0.f;
+static bool occactive = false;
+static u32 occtested = 0, occculled = 0;
+
+void beginocclusion(const mat4x4f &viewproj, float minarea) {
+  occmvp = viewproj;
+  occminarea = minarea;
+  occactive = true;
+  occtested = occculled = 0;
+  loopi(occh) loopj(occw) depth[i][j] = 1.f;
+}
+
+void endocclusion(void) { occactive = false; }
+
+void occlusionstats(u32 &tested, u32 &culled) {
+  tested = occtested;
+  culled = occculled;
+}
+
+static INLINE vec4f clippos(vec3f p) {
+  return occmvp*vec4f(p.x, p.y, p.z, 1.f);
+}
+
+static INLINE vec3f screenpos(const vec4f &c) {
+  const float rw = 1.f/c.w;
+  return vec3f((c.x*rw*0.5f+0.5f)*float(occw), (c.y*rw*0.5f+0.5f)*float(occh), c.z*rw);
+}
+
+// clip the polygon against the near plane (z+w >= 0)
+static int clipnear(const vec4f *in, int n, vec4f *out) {
+  int m = 0;
+  loopi(n) {
+    const vec4f &p0 = in[i], &p1 = in[(i+1)%n];
+    const float d0 = p0.z+p0.w, d1 = p1.z+p1.w;
+    if (d0 >= 0.f) out[m++] = p0;
+    if ((d0 >= 0.f) != (d1 >= 0.f)) {
+      const float t = d0/(d0-d1);
+      out[m++] = p0+t*(p1-p0);
+    }
+  }
+  return m;
+}
+
+// convex polygon with at most 5 vertices (a quad clipped by the near plane)
+static const int maxpolyvert = 5;
+static void rasterize(const vec3f *v, int n) {
+  // signed area and depth plane z = dzdx*x + dzdy*y + z0 from newell normal
+  vec3f nor(zero);
+  vec3f c(zero);
+  loopi(n) {
+    const vec3f &p0 = v[i], &p1 = v[(i+1)%n];
+    nor.x += (p0.y-p1.y)*(p0.z+p1.z);
+    nor.y += (p0.z-p1.z)*(p0.x+p1.x);
+    nor.z += (p0.x-p1.x)*(p0.y+p1.y);
+    c += p0;
+  }
+  if (fabsf(nor.z) < 1e-6f) return;
+  c /= float(n);
+  const float dzdx = -nor.x/nor.z, dzdy = -nor.y/nor.z;
+  const float zbias = 0.5f*(fabsf(dzdx)+fabsf(dzdy)); // farthest depth in the pixel
+  const float z0 = c.z-dzdx*c.x-dzdy*c.y+zbias;
+
+  // edge equations are positive inside the polygon. we test the pixel corner
+  // the most outside to only keep fully covered pixels
+  const float sign = nor.z > 0.f ? 1.f : -1.f;
+  float ea[maxpolyvert], eb[maxpolyvert], ec[maxpolyvert];
+  vec2f pmin(FLT_MAX), pmax(-FLT_MAX);
+  loopi(n) {
+    const vec3f &p0 = v[i], &p1 = v[(i+1)%n];
+    ea[i] = sign*(p0.y-p1.y);
+    eb[i] = sign*(p1.x-p0.x);
+    ec[i] = -(ea[i]*p0.x+eb[i]*p0.y) - 0.5f*(fabsf(ea[i])+fabsf(eb[i]));
+    pmin = min(pmin, vec2f(p0.x,p0.y));
+    pmax = max(pmax, vec2f(p0.x,p0.y));
+  }
+  const int x0 = max(int(floorf(pmin.x)), 0) & ~3, x1 = min(int(ceilf(pmax.x)), occw);
+  const int y0 = max(int(floorf(pmin.y)), 0), y1 = min(int(ceilf(pmax.y)), occh);
+  if (x0 >= x1 || y0 >= y1) return;
+
+#if !defined(__JAVASCRIPT__)
+  const __m128 four = _mm_set1_ps(4.f);
+  for (int y = y0; y < y1; ++y) {
+    const float py = float(y)+0.5f;
+    __m128 px = _mm_add_ps(_mm_set1_ps(float(x0)+0.5f), _mm_set_ps(3.f,2.f,1.f,0.f));
+    for (int x = x0; x < x1; x += 4, px = _mm_add_ps(px, four)) {
+      __m128 inside = _mm_cmpge_ps(px, px); // all ones
+      loopi(n) {
+        const __m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[i]), px), _mm_set1_ps(eb[i]*py+ec[i]));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(e, _mm_setzero_ps()));
+      }
+      if (_mm_movemask_ps(inside) == 0) continue;
+      const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), px), _mm_set1_ps(dzdy*py+z0));
+      const __m128 d = _mm_load_ps(&depth[y][x]);
+      const __m128 nd = _mm_min_ps(d, z);
+      _mm_store_ps(&depth[y][x], _mm_or_ps(_mm_and_ps(inside, nd), _mm_andnot_ps(inside, d)));
+    }
+  }
+#else
+  for (int y = y0; y < y1; ++y) {
+    const float py = float(y)+0.5f;
+    for (int x = x0; x < x1; ++x) {
+      const float px = float(x)+0.5f;
+      bool inside = true;
+      loopi(n) inside &= ea[i]*px+eb[i]*py+ec[i] >= 0.f;
+      if (inside) depth[y][x] = min(depth[y][x], dzdx*px+dzdy*py+z0);
+    }
+  }
+#endif // __JAVASCRIPT__
+}
+
+// occluders are stored in world space. they have one null extent
+static void addoccluder(const aabb &box) {
+  const vec3f ext = box.pmax-box.pmin;
+  const int axis = ext.x == 0.f ? 0 : (ext.y == 0.f ? 1 : 2);
+  const int a0 = (axis+1)%3, a1 = (axis+2)%3;
+  if (ext[a0]*ext[a1] < occminarea) return;
+  vec4f quad[4], clipped[maxpolyvert];
+  loopi(4) {
+    vec3f p = box.pmin;
+    if (i==1||i==2) p[a0] = box.pmax[a0];
+    if (i>=2) p[a1] = box.pmax[a1];
+    quad[i] = clippos(p.xzy());
+  }
+  const int n = clipnear(quad, 4, clipped);
+  if (n < 3) return;
+  vec3f screen[maxpolyvert];
+  loopi(n) screen[i] = screenpos(clipped[i]);
+  rasterize(screen, n);
+}
+
+void addoccluders(const lvl1grid &b) {
+  if (!occactive) return;
+  loopv(b.occluders) addoccluder(b.occluders[i]);
+}
+
+bool isoccluded(const aabb &box) {
+  if (!occactive) return false;
+  ++occtested;
+  vec3f smin(FLT_MAX), smax(-FLT_MAX);
+  loopi(8) {
+    const vec3f p((i&1)?box.pmax.x:box.pmin.x,
+                  (i&2)?box.pmax.y:box.pmin.y,
+                  (i&4)?box.pmax.z:box.pmin.z);
+    const vec4f c = clippos(p);
+    if (c.z+c.w < 0.f) return false; // crosses the near plane
+    const vec3f s = screenpos(c);
+    smin = min(smin, s);
+    smax = max(smax, s);
+  }
+  const int x0 = max(int(floorf(smin.x)), 0), x1 = min(int(ceilf(smax.x)), occw);
+  const int y0 = max(int(floorf(smin.y)), 0), y1 = min(int(ceilf(smax.y)), occh);
+  if (x0 >= x1 || y0 >= y1) return false;
+  for (int y = y0; y < y1; ++y)
+  for (int x = x0; x < x1; ++x)
+    if (depth[y][x] >= smin.z) return false;
+  ++occculled;
+  return true;
+}
+
+} // namespace world
+} // namespace cube
+
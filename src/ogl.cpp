@@ -1,5 +1,9 @@
 #include "cube.hpp"
 #include "bvh.hpp"
+#include "brickmesh.hpp"
+#include "meshpool.hpp"
+#include "base/task.hpp"
+#include "oglrecord.hpp"
 #include <SDL/SDL.h>
 #include <SDL/SDL_image.h>
 
@@ -302,14 +306,16 @@ static void bindtexture(u32 target, u32 texslot, u32 id) {
   OGL(BindTexture, target, id);
 }
 
+// bound in place of the textures that are not loaded yet
+static u32 placeholdertex = 0;
+
 void bindgametexture(u32 target, u32 id) {
-  bindtexture(GL_TEXTURE_2D, 0, generatedids[id]);
+  bindtexture(GL_TEXTURE_2D, 0, generatedids[id] ? generatedids[id] : placeholdertex);
 }
 
 INLINE bool ispoweroftwo(unsigned int x) { return ((x&(x-1))==0); }
 
-bool installtex(int tnum, const char *texname, int &xs, int &ys, bool clamp) {
-  SDL_Surface *s = IMG_Load(texname);
+static bool uploadtex(int tnum, SDL_Surface *s, const char *texname, int &xs, int &ys, bool clamp) {
   if (!s) {
     console::out("couldn't load texture %s", texname);
     return false;
@@ -351,10 +357,40 @@ bool installtex(int tnum, const char *texname, int &xs, int &ys, bool clamp) {
     OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   }
-  SDL_FreeSurface(s);
   return true;
 }
 
+bool installtex(int tnum, const char *texname, int &xs, int &ys, bool clamp) {
+  SDL_Surface *s = IMG_Load(texname);
+  const bool ok = uploadtex(tnum, s, texname, xs, ys, clamp);
+  if (s) SDL_FreeSurface(s);
+  return ok;
+}
+
+// the image is decoded by a task thread and uploaded by the main thread.
+// the slot shows the placeholder until then
+struct texturerequest : asset::request {
+  texturerequest(int tnum, const char *texname, bool clamp, vec2i *dim) :
+    asset::request("texture"), tnum(tnum), clamp(clamp), dim(dim), s(NULL)
+  { strcpy_s(name, texname); }
+  virtual ~texturerequest(void) { if (s) SDL_FreeSurface(s); }
+  virtual void load(void) { s = IMG_Load(name); }
+  virtual void finish(void) {
+    int xs, ys;
+    if (uploadtex(tnum, s, name, xs, ys, clamp) && dim) *dim = vec2i(xs, ys);
+  }
+  int tnum;
+  bool clamp;
+  vec2i *dim;
+  SDL_Surface *s;
+  string name;
+};
+
+void requesttex(int tnum, const char *texname, bool clamp) {
+  if (tnum >= int(IDNUM)) fatal("out of bound texture ID");
+  asset::submit(NEW(texturerequest, tnum, texname, clamp, (vec2i*) NULL));
+}
+
 int lookuptex(int tex, int &xs, int &ys) {
   const int frame = 0; // other frames?
   int tid = mapping[tex][frame];
@@ -383,13 +419,17 @@ int lookuptex(int tex, int &xs, int &ys) {
 
   sprintf_sd(name)("packages%c%s", PATHDIV, texname[curtex]);
 
-  if (installtex(tnum, name, xs, ys)) {
-    mapping[tex][frame] = tnum;
-    texdim[curtex] = vec2i(xs, ys);
-    curtex++;
-    return tnum;
-  } else
-    return mapping[tex][frame] = FIRSTTEX;  // temp fix
+  // the placeholder is drawn until the texture is loaded
+  texdim[curtex] = vec2i(xs, ys);
+  asset::submit(NEW(texturerequest, tnum, name, false, texdim+curtex));
+  mapping[tex][frame] = tnum;
+  curtex++;
+  return tnum;
+}
+
+const char *texturename(int tex) {
+  if (tex < 0 || tex >= MAXMAPTEX || mapping[tex][0] == 0) return NULL;
+  return mapname[tex][0];
 }
 
 static void texturereset(void) { curtexnum = 0; }
@@ -677,28 +717,27 @@ static void buildubershader(shader &shader, u32 rules) {
   buildshader(shader, ubervert, uberfrag, rules);
 }
 
+// positions and texture coordinates are fixed point values relative to the
+// brick. light map coordinates are texel coordinates
 static const char gridvert[] = {
   "uniform mat4 u_mvp;\n"
+  "uniform vec3 u_org;\n"
+  "uniform vec2 u_rlmdim;\n"
   "VS_IN vec3 vs_pos;\n"
-  "VS_IN vec4 vs_col;\n"
   "VS_IN vec2 vs_tex;\n"
   "VS_IN vec2 vs_lm;\n"
-  "VS_OUT vec4 fs_col;\n"
   "VS_OUT vec2 fs_tex;\n"
   "VS_OUT vec2 fs_lm;\n"
   "void main() {\n"
-  "  fs_tex = vs_tex;\n"
-  "  fs_col = vs_col;\n"
-  "  fs_lm = vs_lm;\n"
-  "  gl_Position = u_mvp*vec4(vs_pos,1.0);\n"
+  "  fs_tex = vs_tex*(1.0/255.0);\n"
+  "  fs_lm = vs_lm*u_rlmdim;\n"
+  "  gl_Position = u_mvp*vec4(u_org+vs_pos*(1.0/255.0),1.0);\n"
   "}\n"
 };
 static const char gridfrag[] = {
   "uniform sampler2D u_diffuse;\n"
   "uniform sampler2D u_lm;\n"
-  "uniform vec2 u_rlmdim;\n"
   "PS_IN vec2 fs_tex;\n"
-  "PS_IN vec4 fs_col;\n"
   "PS_IN vec2 fs_lm;\n"
   IF_NOT_WEBGL("out vec4 rt_c;\n")
   "void main() {\n"
@@ -708,7 +747,7 @@ static const char gridfrag[] = {
   "}\n"
 };
 static struct gridshader : shader {
-  u32 u_lm, u_rlmdim;
+  u32 u_lm, u_rlmdim, u_org;
 } gridshader;
 
 static void buildshaders(void) {
@@ -730,6 +769,7 @@ static void buildshaders(void) {
   OGL(UseProgram, gridshader.program);
   OGLR(gridshader.u_lm, GetUniformLocation, gridshader.program, "u_lm");
   OGLR(gridshader.u_rlmdim, GetUniformLocation, gridshader.program, "u_rlmdim");
+  OGLR(gridshader.u_org, GetUniformLocation, gridshader.program, "u_org");
   OGL(Uniform1i, gridshader.u_lm, 1);
   OGL(UseProgram, 0);
 }
@@ -747,130 +787,299 @@ static vec3f ldir;
 VAR(sampling, 0,0,1);
 
 /*--------------------------------------------------------------------------
- - surface parameterization per brick
+ - light maps
  -------------------------------------------------------------------------*/
 VAR(lmres, 2, 4, 32);
-
-static const int maxlmw = 1024;
 VAR(forcebuild, 0, 0, 1);
+VAR(greedymesh, 0, 1, 1); // merge coplanar faces in bigger quads
 
-// store UVs per cube and per face
-struct lightmapuv {
-  INLINE lightmapuv(void) : dim(zero) {MEMZERO(uv);}
-#if !defined(NDEBUG)
-  bool isinbound(vec3i idx, u32 corner, u32 face) const {
-    return all(idx>=vec3i(zero)) &&
-           all(idx<vec3i(world::lvl1)) &&
-           face<6 && corner<4;
-  }
-#endif // NDEBUG
-  INLINE void set(vec3i idx, vec2i v, u32 corner, u32 face) {
-    ASSERT(isinbound(idx, corner, face));
-    uv[face][idx.x][idx.y][idx.z][corner] = v;
-  }
-  INLINE vec2i get(vec3i idx, u32 corner, u32 face) const {
-    ASSERT(isinbound(idx, corner, face));
-    return uv[face][idx.x][idx.y][idx.z][corner];
-  }
-  vec2i uv[6][world::lvl1][world::lvl1][world::lvl1][4];
-  vec2i dim;
-};
+using world::lightmapquad;
 
-struct surfaceparamctx {
-  INLINE surfaceparamctx(const world::lvl1grid &b, lightmapuv &lmuv) :
-    b(b), lmuv(lmuv), lm(NULL), face(0) {}
-  INLINE void set(vec3i idx, vec2i uv, u32 corner) {lmuv.set(idx, uv, corner, face);}
-  INLINE vec2i get(vec3i idx, u32 corner) const {return lmuv.get(idx, corner, face);}
-  const world::lvl1grid &b;
-  lightmapuv &lmuv;
-  u32 *lm;
-  u32 face;
+static int raynum = 0;
+
+/*--------------------------------------------------------------------------
+ - point lights (LIGHT entities). we index them per brick such that every
+ - texel only considers the lights whose sphere overlaps its brick
+ -------------------------------------------------------------------------*/
+struct pointlight {
+  INLINE pointlight(void) {}
+  INLINE pointlight(vec3f pos, float radius, float intensity) :
+    pos(pos), radius(radius), intensity(intensity) {}
+  vec3f pos;
+  float radius, intensity;
 };
+INLINE bool operator!= (const pointlight &l0, const pointlight &l1) {
+  return any(l0.pos!=l1.pos) || l0.radius!=l1.radius || l0.intensity!=l1.intensity;
+}
+
+static const int brickn = world::size/world::lvl1;
+static vector<pointlight> lights;
+static vector<u16> lightlist; // light indices sorted by brick
+static vector<u32> lightfirst; // brick -> lightlist range
+
+INLINE u32 brickid(vec3i xyz) {
+  const vec3i b = xyz/world::lvl1;
+  return (b.x*brickn+b.y)*brickn+b.z;
+}
+
+template <typename F>
+static void forallbricksinlight(const pointlight &l, const F &f) {
+  const vec3f r(l.radius+1.f); // displaced vertices may go one cube further
+  const vec3i pmin = clamp(vec3i(l.pos-r)/world::lvl1, vec3i(zero), vec3i(brickn-1));
+  const vec3i pmax = clamp(vec3i(l.pos+r)/world::lvl1, vec3i(zero), vec3i(brickn-1));
+  loopxyz(pmin, pmax+vec3i(one), {
+    const vec3f bmin = vec3f(xyz*world::lvl1)-vec3f(one);
+    const vec3f bmax = vec3f((xyz+vec3i(one))*world::lvl1)+vec3f(one);
+    const vec3f d = max(max(bmin-l.pos, l.pos-bmax), vec3f(zero));
+    if (dot(d,d) < l.radius*l.radius) f((xyz.x*brickn+xyz.y)*brickn+xyz.z);
+  });
+}
 
-static void buildlmuv(surfaceparamctx &ctx, vec3i xyz, vec3i idx) {
-  if (!world::visibleface(xyz, ctx.face)) return;
-  if (ctx.lmuv.dim.x+lmres+2 >= maxlmw) {
-    ctx.lmuv.dim.x = 0;
-    ctx.lmuv.dim.y += lmres+2;
-  }
-  ctx.set(idx, ctx.lmuv.dim, 0);
-  ctx.set(idx, ctx.lmuv.dim+vec2i(lmres,0), 1);
-  ctx.set(idx, ctx.lmuv.dim+vec2i(lmres), 2);
-  ctx.set(idx, ctx.lmuv.dim+vec2i(0,lmres), 3);
-  ctx.lmuv.dim.x += lmres+2;
+static bool samelights(const vector<pointlight> &l0, const vector<u16> &list0,
+                       const vector<u32> &first0, u32 id)
+{
+  const u32 n0 = first0.size() ? first0[id+1]-first0[id] : 0;
+  const u32 n1 = lightfirst[id+1]-lightfirst[id];
+  if (n0 != n1) return false;
+  loopi(s32(n0))
+    if (l0[list0[first0[id]+i]] != lights[lightlist[lightfirst[id]+i]])
+      return false;
+  return true;
 }
 
-static bvh::intersector *bvhisec = NULL; // XXX naughty global
-static int raynum = 0;
+// rebuild the index if the lights changed and mark the bricks to relight
+static void buildlightindex(void) {
+  if (lightfirst.size() == 0) {
+    lightfirst.resize(brickn*brickn*brickn+1);
+    loopv(lightfirst) lightfirst[i] = 0;
+  }
+  vector<pointlight> newlights;
+  loopv(game::ents) {
+    const auto &e = game::ents[i];
+    if (e.type != game::LIGHT || e.attr1 <= 0) continue;
+    const vec3f pos = vec3f(float(e.x), float(e.y), float(e.z)) + vec3f(0.5f);
+    newlights.add(pointlight(pos, float(e.attr1), float(e.attr2)/255.f));
+  }
+  if (newlights.size() == lights.size()) {
+    bool same = true;
+    loopv(lights) if (lights[i] != newlights[i]) { same = false; break; }
+    if (same) return;
+  }
+  if (newlights.size() > 0xffff) newlights.resize(0xffff);
+
+  // count lights per brick, then fill the list
+  vector<pointlight> oldlights;
+  vector<u16> oldlist;
+  vector<u32> oldfirst;
+  oldlights.swap(lights);
+  oldlist.swap(lightlist);
+  oldfirst.swap(lightfirst);
+  lights.swap(newlights);
+  lightfirst.resize(oldfirst.size());
+  loopv(lightfirst) lightfirst[i] = 0;
+  loopv(lights) forallbricksinlight(lights[i], [&](u32 id) {++lightfirst[id+1];});
+  loopi(lightfirst.size()-1) lightfirst[i+1] += lightfirst[i];
+  lightlist.resize(lightfirst.back());
+  vector<u32> cursor(lightfirst.size());
+  loopv(lightfirst) cursor[i] = lightfirst[i];
+  loopv(lights) {
+    const u16 idx = u16(i);
+    forallbricksinlight(lights[i], [&](u32 id) {lightlist[cursor[id]++] = idx;});
+  }
 
-static void buildlmdata(surfaceparamctx &ctx, vec3i xyz, vec3i idx) {
-  if (!world::visibleface(xyz, ctx.face)) return;
-
-  const auto uv = ctx.get(idx, 0);
-  ASSERT(all(uv!=vec2i(~0x0)) && all(uv>=vec2i(zero)) && all(uv<ctx.lmuv.dim));
-
-  const vec4i quad = cubequads[ctx.face];
-  const vec3f org = world::getpos(xyz+cubeiverts[quad[0]]);
-  const vec3f b = world::getpos(xyz+cubeiverts[quad[3]]);
-  const vec3f c = world::getpos(xyz+cubeiverts[quad[1]]);
-  const vec3f u = b-org;
-  const vec3f v = c-org;
-  const float d = 1.f/float(lmres);
-  const float nbias = 0.01f;
-  const vec3f n = vec3f(cubenorms[ctx.face]);
-
-  // fill the quad location at "uv"
-  u32 *l = ctx.lm + uv.y*ctx.lmuv.dim.x + uv.x;
-  auto dolighting = [&](int i, int j) {
-    const vec3f p = org + float(i)*d*u + float(j)*d*v + nbias*n;
-    const ray r(p, ldir);
-    bool isec = false;
-    if (bvhisec && world::usebvh) {
-      isec = occluded(*bvhisec, r);
-    } else
-      isec = world::castray(r).isec;
+  // only bricks that do not see the same lights need to be baked again
+  world::forallbricks([&](world::lvl1grid &b, vec3i org) {
+    if (samelights(oldlights, oldlist, oldfirst, brickid(org))) return;
+    b.dirty = 1;
+    world::root.dirty = 1;
+  });
+}
+
+// a texel value only depends on its position in the quad. so, whatever the
+// order we use to compute texels, we always end up with the same light map
+struct lightmapquadctx {
+  INLINE lightmapquadctx(const lightmapquad &q, u32 *lm, vec2i dim) :
+    uv(q.uv), dim(dim), n(cubenorms[q.face]),
+    rows(q.size.x*lmres), cols(q.size.y*lmres)
+  {
+    const u32 id = brickid(q.xyz);
+    lightids = lightlist.data() + lightfirst[id];
+    lightnum = lightfirst[id+1] - lightfirst[id];
+    ASSERT(all(uv>=vec2i(zero)) && all(uv<dim));
+    const vec4i quad = cubequads[q.face];
+    org = world::getpos(q.xyz+cubeiverts[quad[0]]);
+    u = world::getpos(q.xyz+cubeiverts[quad[3]])-org;
+    v = world::getpos(q.xyz+cubeiverts[quad[1]])-org;
+    l = lm + uv.y*dim.x + uv.x;
+  }
+  static bool occluded(const ray &r) {
     ++raynum;
-    const float lum = (isec?0.f:1.f) * max(dot(ldir,normalize(n)),0.f);
+    const bvh::intersector *bvhisec = world::getbvh();
+    if (bvhisec && world::usebvh)
+      return bvh::occluded(*bvhisec, r);
+    const isecres res = world::castray(r);
+    return res.isec && res.t < r.tfar;
+  }
+  u32 lighting(int i, int j) const {
+    const float d = 1.f/float(lmres);
+    const float nbias = 0.01f;
+    const vec3f p = org + float(i)*d*u + float(j)*d*v + nbias*n;
+    float lum = occluded(ray(p, ldir)) ? 0.f : max(dot(ldir,n),0.f);
+    loopk(s32(lightnum)) {
+      const pointlight &light = lights[lightids[k]];
+      const vec3f l = light.pos-p;
+      const float dist = length(l);
+      if (dist >= light.radius) continue;
+      const float ndotl = dot(l,n)/dist;
+      if (ndotl <= 0.f || lum >= 1.f) continue;
+      if (occluded(ray(p, l/dist, 0.f, dist))) continue;
+      lum += light.intensity*(1.f-dist/light.radius)*ndotl;
+    }
     const u32 qlum = u32(clamp(255.f*lum, 0.f, 255.f));
-    l[i*ctx.lmuv.dim.x+j] = qlum | (qlum<<8) | (qlum<<16) | 0xff000000;
-  };
-  loopi(lmres) loopj(lmres) dolighting(i,j);
+    return qlum | (qlum<<8) | (qlum<<16) | 0xff000000;
+  }
+  INLINE void set(int i, int j, u32 texel) { l[i*dim.x+j] = texel; }
+  INLINE u32 get(int i, int j) const { return l[i*dim.x+j]; }
+  INLINE void dolighting(int i, int j) { set(i, j, lighting(i,j)); }
+  INLINE bool hasbottom(void) const { return uv.y+rows<dim.y; }
+  INLINE bool hasright(void) const { return uv.x+cols<dim.x; }
+  INLINE bool hastop(void) const { return uv.y-1>=0; }
+  INLINE bool hasleft(void) const { return uv.x-1>=0; }
+  vec2i uv, dim;
+  vec3f org, u, v, n;
+  int rows, cols; // texels along u and along v
+  const u16 *lightids;
+  u32 lightnum;
+  u32 *l;
+};
+
+// compute all texels of the quad but the ones already computed by a coarse
+// pass of the given step (0 if there was no coarse pass)
+static void buildlmdata(const lightmapquad &q, u32 *lm, vec2i dim, int done) {
+  lightmapquadctx ctx(q, lm, dim);
+  const int rows = ctx.rows, cols = ctx.cols;
+  loopi(rows) loopj(cols) if (done==0 || i%done || j%done) ctx.dolighting(i,j);
 
   // take care of the borders for bilinear filtering
-  if (uv.y+lmres<ctx.lmuv.dim.y) loopj(lmres) dolighting(lmres,j);
-  if (uv.x+lmres<ctx.lmuv.dim.x) loopi(lmres) dolighting(i,lmres);
-  if (uv.y+lmres<ctx.lmuv.dim.y && uv.x+lmres<ctx.lmuv.dim.x)
-    dolighting(lmres,lmres);
-  if (uv.y-1>=0) loopj(lmres) dolighting(-1,j);
-  if (uv.x-1>=0) loopi(lmres) dolighting(i,-1);
-  if (uv.x-1>=0 && uv.y-1>=0) dolighting(-1,-1);
+  if (ctx.hasbottom()) loopj(cols) ctx.dolighting(rows,j);
+  if (ctx.hasright()) loopi(rows) ctx.dolighting(i,cols);
+  if (ctx.hasbottom() && ctx.hasright()) ctx.dolighting(rows,cols);
+  if (ctx.hastop()) loopj(cols) ctx.dolighting(-1,j);
+  if (ctx.hasleft()) loopi(rows) ctx.dolighting(i,-1);
+  if (ctx.hastop() && ctx.hasleft()) ctx.dolighting(-1,-1);
+}
+
+// only compute one texel every step texels and replicate it
+static void buildlmcoarse(const lightmapquad &q, u32 *lm, vec2i dim, int step) {
+  lightmapquadctx ctx(q, lm, dim);
+  const int rows = ctx.rows, cols = ctx.cols;
+  for (int i = 0; i < rows; i += step)
+  for (int j = 0; j < cols; j += step) {
+    const u32 texel = ctx.lighting(i,j);
+    for (int k = i; k < min(i+step,rows); ++k)
+    for (int m = j; m < min(j+step,cols); ++m)
+      ctx.set(k,m,texel);
+  }
+
+  // borders just copy the edges
+  if (ctx.hasbottom()) loopj(cols) ctx.set(rows,j,ctx.get(rows-1,j));
+  if (ctx.hasright()) loopi(rows) ctx.set(i,cols,ctx.get(i,cols-1));
+  if (ctx.hasbottom() && ctx.hasright()) ctx.set(rows,cols,ctx.get(rows-1,cols-1));
+  if (ctx.hastop()) loopj(cols) ctx.set(-1,j,ctx.get(0,j));
+  if (ctx.hasleft()) loopi(rows) ctx.set(i,-1,ctx.get(i,0));
+  if (ctx.hastop() && ctx.hasleft()) ctx.set(-1,-1,ctx.get(0,0));
 }
 
+/*--------------------------------------------------------------------------
+ - progressive light map baking. a dirty brick first gets a coarse light map
+ - and is then refined quad after quad with a time budget per frame. refined
+ - rows of quads are uploaded as soon as they are complete
+ -------------------------------------------------------------------------*/
 VAR(lmfilter,0,0,1);
+VAR(lmprogressive,0,1,1);
+VAR(lmcoarse,1,4,32); // texel step of the first pass
+VAR(lmbudget,1,4,1000); // msec per frame spent to refine light maps
+
+// cpu copy of a brick light map. it also tracks its progressive refinement
+// and stays around once done such that the cpu renderer can sample it
+struct lightmapbake {
+  INLINE lightmapbake(vector<lightmapquad> &q, u32 *lm, vec2i dim, int step, u32 tex) :
+    lm(lm), dim(dim), step(step), next(0), uploaded(0), tex(tex) { quads.swap(q); }
+  INLINE ~lightmapbake(void) { SAFE_DELETEA(lm); }
+  INLINE bool pending(void) const { return next < quads.size(); }
+  vector<lightmapquad> quads; // in light map order
+  u32 *lm; // cpu copy of the light map
+  vec2i dim; // light map dimension
+  int step; // step of the coarse pass (0 if coarse texels must be recomputed)
+  s32 next; // next quad to refine
+  int uploaded; // refined rows below it are already in the texture
+  u32 tex; // texture refined (pending until the mesh is uploaded)
+};
 
-static void buildlightmap(world::lvl1grid &b, lightmapuv &lmuv, const vec3i &org) {
-  surfaceparamctx ctx(b, lmuv);
-  loopi(6) {
-    ctx.face = i;
-    loopxyz(0, b.size(), buildlmuv(ctx, org+xyz, xyz));
+static int bakepending = 0; // number of bricks with a pending refinement
+static u32 bakemsec = 0; // time spent to refine them
+
+void destroylightmapbake(lightmapbake *bake) {
+  if (bake->pending()) --bakepending;
+  SAFE_DELETE(bake);
+}
+
+// quads are output face after face and then slice after slice in the brick
+static INLINE u32 quadkey(vec3i xyz, u32 face) {
+  const vec3i idx = xyz % world::brickisize;
+  return (face<<4) | idx[face/2];
+}
+
+u32 lightmaptexel(const lightmapbake *bake, const vec3i &xyz, u32 face, const vec3f &p) {
+  if (bake == NULL) return 0xffffffff;
+  const u32 key = quadkey(xyz, face);
+  s32 first = 0, last = bake->quads.size();
+  while (first < last) {
+    const s32 mid = (first+last)/2;
+    const lightmapquad &q = bake->quads[mid];
+    if (quadkey(q.xyz, q.face) < key) first = mid+1; else last = mid;
   }
-  ctx.lmuv.dim.x = maxlmw;
-  ctx.lmuv.dim.y += lmres+2;
 
-  const s32 lmn = lmuv.dim.x*lmuv.dim.y;
-  ctx.lm = NEWAE(u32,lmn);
-  memset(ctx.lm, 0, sizeof(u32)*lmn);
-  loopi(lmn) ctx.lm[i] = 0;
-  loopi(6) {
-    ctx.face = i;
-    loopxyz(0, b.size(), buildlmdata(ctx, org+xyz, xyz));
+  // look for the rectangle of faces that contains the cube in the slice
+  const vec3f u(world::quadu(face)), v(world::quadv(face));
+  for (; first < bake->quads.size(); ++first) {
+    const lightmapquad &q = bake->quads[first];
+    if (quadkey(q.xyz, q.face) != key) break;
+    const vec3i d = xyz-q.xyz;
+    const int a = dot(d, world::quadu(face)), b = dot(d, world::quadv(face));
+    if (a < 0 || a >= q.size.x || b < 0 || b >= q.size.y) continue;
+
+    // same texel as the one nearest-sampled by the grid shader
+    const vec3f org(q.xyz+cubeiverts[cubequads[face][0]]);
+    const int i = clamp(int(dot(p-org,u)*float(lmres)), 0, q.size.x*lmres-1);
+    const int j = clamp(int(dot(p-org,v)*float(lmres)), 0, q.size.y*lmres-1);
+    return bake->lm[(q.uv.y+i)*bake->dim.x + q.uv.x+j];
   }
+  return 0xffffffff;
+}
+
+static void uploadlightmap(u32 id, const u32 *lm, vec2i dim, int y0, int y1) {
+  if (y1 <= y0) return;
+  ogl::bindtexture(GL_TEXTURE_2D, 0, id);
+  OGL(PixelStorei, GL_UNPACK_ALIGNMENT, 1);
+  OGL(TexSubImage2D, GL_TEXTURE_2D, 0, 0, y0, dim.x, y1-y0, GL_RGBA, GL_UNSIGNED_BYTE, lm+y0*dim.x);
+}
+
+static void buildlightmap(world::lvl1grid &b, vector<lightmapquad> &quads, vec2i dim) {
+  const s32 lmn = dim.x*dim.y;
+  u32 *lm = NEWAE(u32,lmn);
+  memset(lm, 0, sizeof(u32)*lmn);
+  const int step = lmprogressive ? min(int(lmcoarse),int(lmres)) : 1;
+  if (step > 1)
+    loopv(quads) buildlmcoarse(quads[i], lm, dim, step);
+  else
+    loopv(quads) buildlmdata(quads[i], lm, dim, 0);
 
-  // build light map texture
-  if (b.lm == 0) gentextures(1, &b.lm);
-  ogl::bindtexture(GL_TEXTURE_2D, 0, b.lm);
+  // build light map texture. the drawn mesh still uses the previous one
+  if (b.pendinglm == 0) gentextures(1, &b.pendinglm);
+  ogl::bindtexture(GL_TEXTURE_2D, 0, b.pendinglm);
   OGL(PixelStorei, GL_UNPACK_ALIGNMENT, 1);
-  OGL(TexImage2D, GL_TEXTURE_2D, 0, GL_RGBA, lmuv.dim.x, lmuv.dim.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, ctx.lm);
+  OGL(TexImage2D, GL_TEXTURE_2D, 0, GL_RGBA, dim.x, dim.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, lm);
   OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
   OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, lmfilter?GL_LINEAR:GL_NEAREST);
@@ -879,198 +1088,541 @@ static void buildlightmap(world::lvl1grid &b, lightmapuv &lmuv, const vec3i &org
 // static int lmid = 0;
 //  sprintf_sd(filename)("lm%i.bmp", lmid++);
 //  console::out("saving %s", filename);
-//  writebmp((const int*) ctx.lm, lmuv.dim.x, lmuv.dim.y, filename);
-  b.rlmdim = rcp(vec2f(lmuv.dim));
-  SAFE_DELETEA(ctx.lm);
+//  writebmp((const int*) lm, dim.x, dim.y, filename);
+  b.pendingrlmdim = rcp(vec2f(dim));
+  if (b.bake) destroylightmapbake(b.bake);
+  b.bake = NULL;
+  if (quads.size() != 0) {
+    b.bake = NEW(lightmapbake, quads, lm, dim, step, b.pendinglm);
+    if (step > 1)
+      ++bakepending;
+    else
+      b.bake->next = b.bake->quads.size();
+  } else
+    SAFE_DELETEA(lm);
+}
+
+static void refinelightmaps(void) {
+  if (bakepending == 0) return;
+  const auto start = SDL_GetTicks();
+  bool timeout = false;
+  world::forallbricks([&](world::lvl1grid &b, vec3i org) {
+    if (timeout || b.bake == NULL || !b.bake->pending()) return;
+    auto &bake = *b.bake;
+    while (bake.next < bake.quads.size()) {
+      if (SDL_GetTicks()-start >= u32(lmbudget)) {
+        timeout = true;
+        break;
+      }
+      const auto &q = bake.quads[bake.next++];
+      // rows of the previous quad lines are done
+      uploadlightmap(bake.tex, bake.lm, bake.dim, bake.uploaded, q.uv.y-1);
+      bake.uploaded = max(bake.uploaded, q.uv.y-1);
+      buildlmdata(q, bake.lm, bake.dim, bake.step);
+    }
+    if (!bake.pending()) {
+      uploadlightmap(bake.tex, bake.lm, bake.dim, bake.uploaded, bake.dim.y);
+      --bakepending;
+    }
+  });
+  bakemsec += SDL_GetTicks()-start;
+  if (bakepending == 0)
+    console::out("light maps refined: %f Mrays in %d msec", raynum/1e6f, bakemsec);
+}
+
+// the world changed: pending refinements must restart from scratch to end up
+// with the same result as a full bake
+static void restartlightmaps(void) {
+  if (bakepending == 0) return;
+  world::forallbricks([&](world::lvl1grid &b, vec3i org) {
+    if (b.bake == NULL || !b.bake->pending()) return;
+    b.bake->next = 0;
+    b.bake->uploaded = 0;
+    b.bake->step = 0;
+  });
 }
 
 /*--------------------------------------------------------------------------
- - world mesh handling (very simple for now)
+ - world mesh handling. dirty bricks are parameterized and meshed in the task
+ - threads. meshes are then uploaded with a time budget per frame
  -------------------------------------------------------------------------*/
-struct brickmeshctx {
-  INLINE brickmeshctx(const world::lvl1grid &b, const lightmapuv &lmuv) :
-    b(b), lmuv(lmuv) {}
-  INLINE void clear(s32 orientation) {
-    face = orientation;
-    MEMSET(indices, 0xff);
-  }
-  INLINE u16 get(vec3i p) const { return indices[p.x][p.y][p.z]; }
-  INLINE void set(vec3i p, u16 idx) { indices[p.x][p.y][p.z] = idx; }
-  const world::lvl1grid &b;
-  const lightmapuv &lmuv;
-  vector<array<float,10>> vbo;
-  vector<u16> ibo;
-  vector<u16> tex;
-  u16 indices[world::lvl1+1][world::lvl1+1][world::lvl1+1];
-  s32 face;
-};
-
 VAR(ldirx,-100,20,100);
 VAR(ldiry,-100,50,100);
 VAR(ldirz,-100,100,100);
+VAR(meshbudget,1,4,1000); // msec per frame spent to upload brick meshes
+
+// the mesh and its light map go live together
+static void swaplightmap(world::lvl1grid &b) {
+  if (b.pendinglm == 0) return;
+  if (b.lm) deletetextures(1, &b.lm);
+  b.lm = b.pendinglm;
+  b.rlmdim = b.pendingrlmdim;
+  b.pendinglm = 0;
+}
+
+// the mesh is copied in the mesh pools. flushmeshpools uploads it
+static void uploadmesh(world::lvl1grid &b) {
+  world::meshblob *m = b.mesh;
+  world::freemesh(b.slot);
+  b.slot = world::allocmesh(*m);
+  b.draws.resize(m->drawnum);
+  loopi(s32(m->drawnum)) b.draws[i] = m->draws()[i];
+  world::deletemeshblob(m);
+  b.mesh = NULL;
+  swaplightmap(b);
+}
+
+// at least one mesh is uploaded per frame whatever the budget
+static void uploadmeshes(void) {
+  const auto start = SDL_GetTicks();
+  bool first = true;
+  world::forallbricks([&](world::lvl1grid &b, vec3i org) {
+    if (b.mesh == NULL || (!first && SDL_GetTicks()-start >= u32(meshbudget))) return;
+    uploadmesh(b);
+    first = false;
+  });
+}
 
-static void buildfacemesh(brickmeshctx &ctx, vec3i xyz, vec3i idx) {
-  if (!world::visibleface(xyz, ctx.face)) return;
-
-  // build both triangles. we reuse already output vertices
-  const int chan = ctx.face/2; // basically: x (0), y (1) or z (2)
-  const int idx0 = 2*ctx.face+0, idx1 = 2*ctx.face+1;
-  const vec3i tris[] = {cubetris[idx0], cubetris[idx1]};
-  const vec3i corners[] = {vec3i(0,1,2), vec3i(0,2,3)};
-  const auto tex = world::getcube(xyz).tex[ctx.face];
-  loopi(2) { // build both triangles
-    vec3f v[3]={zero,zero,zero}; // delay vertex creation for degenerated tris
-    vec2f t[3]={zero,zero,zero}; // idem for texture coordinates
-    vec2f l[3]={zero,zero,zero}; // idem for light map coordinates
-    vec3f c[3]={zero,zero,zero}; // idem for vertex colors
-    vec3i locals[3]={zero,zero,zero};
-    bool isnew[3]={false,false,false};
-    loopj(3) { // build each vertex
-      const vec3i global = xyz+cubeiverts[tris[i][j]];
-      locals[j] = idx+cubeiverts[tris[i][j]];
-      // u16 id = ctx.get(locals[j]);
-    //  if (id == 0xffff) {
-        const vec3f pos = world::getpos(global);
-        const vec2f tex = chan==0?pos.yz():(chan==1?pos.xz():pos.xy());
-        // id = ctx.vbo.size();
-        v[j] = pos.xzy();
-        t[j] = tex;
-        l[j] = vec2f(ctx.lmuv.get(idx,corners[i][j],ctx.face))/vec2f(ctx.lmuv.dim);
-        c[j] = vec3f(one);
-        isnew[j] = true;
-    //  } else
-    //    v[j] = vec3f(ctx.vbo[id][0],ctx.vbo[id][1],ctx.vbo[id][2]);
+// rebuilds leave holes in the pools. pools are compacted when too much is
+// wasted and the modified parts are then uploaded
+VAR(meshwaste,10,50,90); // percentage of wasted vertices before compaction
+static void flushmeshpools(void) {
+  using namespace world;
+  compactmeshpools(float(meshwaste)/100.f);
+  loopi(s32(meshpoolnum())) {
+    meshpool &p = getmeshpool(i);
+    if (p.vbo == 0) {
+      genbuffers(1, &p.vbo);
+      genbuffers(1, &p.ibo);
+      ogl::bindbuffer(ogl::ARRAY_BUFFER, p.vbo);
+      ogl::bindbuffer(ogl::ELEMENT_ARRAY_BUFFER, p.ibo);
+      OGL(BufferData, GL_ARRAY_BUFFER, poolvertices*sizeof(gridvertex), NULL, GL_STATIC_DRAW);
+      OGL(BufferData, GL_ELEMENT_ARRAY_BUFFER, poolindices*sizeof(u16), NULL, GL_STATIC_DRAW);
     }
-    const float mindist = 1.f/512.f;
-    if (distance(v[0], v[1]) < mindist || // degenerated triangle?
-        distance(v[1], v[2]) < mindist ||
-        distance(v[2], v[0]) < mindist)
-      continue;
-    loopj(3) {
-      if (isnew[j]) {
-        ctx.set(locals[j], ctx.vbo.size());
-        ctx.vbo.add(array<float,10>(v[j],t[j],c[j],l[j]));
-      }
-      ctx.ibo.add(ctx.get(locals[j]));
-      ctx.tex.add(tex);
+    const vec2i v = p.dirtyvert, idx = p.dirtyindex;
+    if (v.x < v.y) {
+      ogl::bindbuffer(ogl::ARRAY_BUFFER, p.vbo);
+      OGL(BufferSubData, GL_ARRAY_BUFFER, v.x*sizeof(gridvertex),
+          (v.y-v.x)*sizeof(gridvertex), p.vertices+v.x);
     }
+    if (idx.x < idx.y) {
+      ogl::bindbuffer(ogl::ELEMENT_ARRAY_BUFFER, p.ibo);
+      OGL(BufferSubData, GL_ELEMENT_ARRAY_BUFFER, idx.x*sizeof(u16),
+          (idx.y-idx.x)*sizeof(u16), p.indices+idx.x);
+    }
+    cleanmeshpool(p);
   }
+  bindbuffer(ogl::ARRAY_BUFFER, 0);
+  bindbuffer(ogl::ELEMENT_ARRAY_BUFFER, 0);
 }
 
-static void radixsortibo(brickmeshctx &ctx) {
-  const s32 bitn=8, bucketn=1<<bitn, passn=2, mask=bucketn-1;
-  const auto len = ctx.ibo.size();
-  u16 histo[bucketn];
-  vector<u16> copytex(len), copyibo(len);
-  vector<u16> *pptex[] = {&ctx.tex, &copytex};
-  vector<u16> *ppibo[] = {&ctx.ibo, &copyibo};
-  loopi(passn) {
-    auto &fromtex = *pptex[i], &totex = *pptex[(i+1)%2];
-    auto &fromibo = *ppibo[i], &toibo = *ppibo[(i+1)%2];
-    u32 const shr = i*bitn;
-    MEMZERO(histo); // compute the histogram
-    loopj(len) histo[(fromtex[j]>>shr)&mask]++;
-    u32 pred = histo[0];
-    histo[0] = 0;
-    loopj(bucketn-1) {
-      const u32 next = histo[j+1];
-      histo[j+1] = histo[j] + pred;
-      pred = next;
-    }
-    loopj(len) { // sort using the histogram
-      const u32 k = histo[(fromtex[j]>>shr)&mask]++;
-      totex[k] = fromtex[j];
-      toibo[k] = fromibo[j];
-    }
+static void meshpools(void) {
+  using namespace world;
+  loopi(s32(meshpoolnum())) {
+    const meshpool &p = getmeshpool(i);
+    console::out("pool %d: %d meshes, %d/%d vertices, %d/%d indices", i,
+      p.slots.size(), p.vertlive, p.vertused, p.indexlive, p.indexused);
   }
 }
+COMMAND(meshpools, ARG_NONE);
 
-static void buildgridmesh(world::lvl1grid &b, const lightmapuv &lmuv, vec3i org) {
-  brickmeshctx ctx(b, lmuv);
-  loopi(6) {
-    ctx.clear(i);
-    loopxyz(0, b.size(), buildfacemesh(ctx, org+xyz, xyz));
+// the previous mesh is kept and drawn until the new one is uploaded
+static void setmesh(world::lvl1grid &b, world::meshblob *m) {
+  if (b.mesh) world::deletemeshblob(b.mesh);
+  b.mesh = m;
+  if (m != NULL) return;
+  swaplightmap(b);
+  world::freemesh(b.slot);
+  b.slot = 0;
+  b.draws.resize(0);
+}
+
+static const s32 brickbatch = 64; // snapshots are big. we build by batches
+
+struct brickbuildtask : public task {
+  INLINE brickbuildtask(world::bricksnapshot *s, world::brickbuild *out, u32 n, int res, bool greedy) :
+    task("brickbuildtask", n, 1, 0, UNFAIR), s(s), out(out), res(res), greedy(greedy) {}
+  virtual void run(u32 i) { world::buildbrick(s[i], res, greedy, out[i]); }
+  world::bricksnapshot *s;
+  world::brickbuild *out;
+  int res;
+  bool greedy;
+};
+
+struct brickref {
+  INLINE brickref(void) {}
+  INLINE brickref(world::lvl1grid *b, vec3i org) : b(b), org(org) {}
+  world::lvl1grid *b;
+  vec3i org;
+};
+
+/*--------------------------------------------------------------------------
+ - coarse meshes of the lvl2 nodes. they are built in the background once the
+ - bricks are built and replace the bricks of the nodes far from the viewer
+ -------------------------------------------------------------------------*/
+VAR(lod,0,1,1);
+VAR(loddist,32,128,1024); // nodes farther than that use their coarse mesh
+VAR(lodhysteresis,0,16,256); // until they are closer than loddist-lodhysteresis
+
+struct lodbuildtask : public task {
+  INLINE lodbuildtask(world::lodsnapshot *s) :
+    task("lodbuildtask", 1, 1, 0, UNFAIR), s(s), mesh(NULL), done(0) {}
+  virtual ~lodbuildtask(void) {
+    SAFE_DELETE(s);
+    if (mesh) world::deletemeshblob(mesh);
   }
-  if (ctx.vbo.size() == 0 || ctx.ibo.size() == 0) {
-    if (b.vbo) deletebuffers(1, &b.vbo);
-    if (b.ibo) deletebuffers(1, &b.ibo);
-    b.vbo = b.ibo = 0;
-    return;
+  virtual void run(u32) {
+    mesh = world::buildlod(*s);
+    storerelease(&done, 1);
   }
-  if (ctx.vbo.size() > 0xffff) fatal("too many vertices in the VBO");
-  radixsortibo(ctx);
-  if (b.vbo) deletebuffers(1, &b.vbo);
-  if (b.ibo) deletebuffers(1, &b.ibo);
-  genbuffers(1, &b.vbo);
-  genbuffers(1, &b.ibo);
-  ogl::bindbuffer(ogl::ARRAY_BUFFER, b.vbo);
-  ogl::bindbuffer(ogl::ELEMENT_ARRAY_BUFFER, b.ibo);
-  OGL(BufferData, GL_ARRAY_BUFFER, ctx.vbo.size()*sizeof(float[10]), &ctx.vbo[0][0], GL_STATIC_DRAW);
-  OGL(BufferData, GL_ELEMENT_ARRAY_BUFFER, ctx.ibo.size()*sizeof(u16), &ctx.ibo[0], GL_STATIC_DRAW);
-  bindbuffer(ogl::ARRAY_BUFFER, 0);
-  bindbuffer(ogl::ELEMENT_ARRAY_BUFFER, 0);
-  s32 n=1, tex=ctx.tex[0], len=ctx.ibo.size()-1;
-  b.draws.resize(0);
-  loopi(len)
-    if (ctx.tex[i+1]!=tex) {
-      b.draws.add(vec2i(n,tex));
-      tex=ctx.tex[i+1];
-      n=1;
-    } else
-      ++n;
-  b.draws.add(vec2i(n,tex));
+  world::lodsnapshot *s;
+  world::meshblob *mesh;
+  volatile s32 done;
+};
+
+struct lodnode {
+  INLINE lodnode(void) : slot(0), frame(0), dirty(0), coarse(0) {}
+  ref<lodbuildtask> job; // pending build if any
+  u32 slot; // location of the mesh in the mesh pools
+  vector<vec2i> draws; // (elemnum, texid)
+  u32 frame; // last frame the node was put in the draw list
+  u32 dirty:1; // built again once the pending build is done
+  u32 coarse:1; // drawn with its coarse mesh
+};
+static lodnode lods[world::lvl3][world::lvl3][world::lvl3];
+static u32 lodshadetex = 0;
+
+static INLINE lodnode &getlod(vec3i org) {
+  const vec3i idx = org/world::lvlt2;
+  return lods[idx.x][idx.y][idx.z];
 }
 
-static void buildbrick(world::lvl1grid &b, vec3i org) {
-  if (b.dirty==0 && !forcebuild) return;
-  lightmapuv lmuv;
-  buildlightmap(b, lmuv, org);
-  buildgridmesh(b, lmuv, org);
-  //console::out("lightmap [%i %i]", lmuv.dim.x, lmuv.dim.y);
-  b.dirty = 0;
+// face masks of all dirty bricks are needed by the bvh. so, we first build
+// all bricks, then the bvh and finally the light maps
+static void buildbricks(void) {
+  vector<brickref> dirty;
+  world::forallbricks([&](world::lvl1grid &b, vec3i org) {
+    if (b.dirty || forcebuild) dirty.add(brickref(&b, org));
+  });
+  const s32 n = min(dirty.size(), brickbatch);
+  world::bricksnapshot *snapshots = n ? NEWAE(world::bricksnapshot, n) : NULL;
+  world::brickbuild *builds = dirty.size() ? NEWAE(world::brickbuild, dirty.size()) : NULL;
+  for (s32 first = 0; first < dirty.size(); first += n) {
+    const s32 num = min(dirty.size()-first, n);
+    loopi(num) world::snapshot(snapshots[i], dirty[first+i].org);
+    ref<task> job = NEW(brickbuildtask, snapshots, builds+first, num, lmres, greedymesh!=0);
+    job->scheduled();
+    job->wait();
+    loopi(num) memcpy(dirty[first+i].b->faces, snapshots[i].faces, sizeof(snapshots[i].faces));
+  }
+  SAFE_DELETEA(snapshots);
+  world::updatebvh();
+  loopv(dirty) {
+    world::lvl1grid &b = *dirty[i].b;
+    buildlightmap(b, builds[i].quads, builds[i].lmdim);
+    setmesh(b, builds[i].mesh);
+    b.occluders.swap(builds[i].occluders);
+    b.dirty = 0;
+    getlod(dirty[i].org).dirty = 1;
+  }
+  SAFE_DELETEA(builds);
+}
+
+// faces of the coarse meshes are only lit by the sun with their orientation
+static void buildlodshade(void) {
+  const vec2i dim = world::lodshadedim;
+  u32 texels[world::lodshadew*world::lodshadeh];
+  loopi(6) {
+    const float lum = max(dot(ldir, vec3f(cubenorms[i])), 0.f);
+    const u32 qlum = u32(clamp(255.f*lum, 0.f, 255.f));
+    const u32 texel = qlum | (qlum<<8) | (qlum<<16) | 0xff000000;
+    loopj(dim.y) texels[j*dim.x+2*i] = texels[j*dim.x+2*i+1] = texel;
+  }
+  if (lodshadetex == 0) gentextures(1, &lodshadetex);
+  ogl::bindtexture(GL_TEXTURE_2D, 0, lodshadetex);
+  OGL(PixelStorei, GL_UNPACK_ALIGNMENT, 1);
+  OGL(TexImage2D, GL_TEXTURE_2D, 0, GL_RGBA, dim.x, dim.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+  OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 }
 
 static void buildgrid(void) {
+  buildlightindex();
   if (world::root.dirty==0 && !forcebuild) return;
   ldir = normalize(vec3f(float(ldirx), float(ldiry), float(ldirz)));
   const auto start = SDL_GetTicks();
   raynum = 0;
-  forallbricks(buildbrick);
+  bakemsec = 0;
+  restartlightmaps();
+  buildbricks();
+  buildlodshade();
+  loop(x,world::lvl3) loop(y,world::lvl3) loop(z,world::lvl3) // emptied nodes
+    if (!world::root.nonempty(vec3i(x,y,z)) && lods[x][y][z].draws.size() != 0)
+      lods[x][y][z].dirty = 1;
   const auto end = SDL_GetTicks();
   console::out("%f Mrays in %d msec. %f Mrays/s",
     raynum/1e6f, end-start, float(raynum) / float(end-start) * 1000.f);
   forcebuild = 0;
   world::root.dirty = 0;
-  if (bvhisec) bvh::destroy(bvhisec);
-  bvhisec = world::buildbvh();
 }
 COMMAND(buildgrid, ARG_NONE);
+void buildworld(void) { buildgrid(); }
+
+static void uploadlod(lodnode &n, world::meshblob *m) {
+  world::freemesh(n.slot);
+  n.slot = 0;
+  n.draws.resize(0);
+  if (m == NULL) return;
+  n.slot = world::allocmesh(*m);
+  n.draws.resize(m->drawnum);
+  loopi(s32(m->drawnum)) n.draws[i] = m->draws()[i];
+}
+
+// finished builds are uploaded and dirty nodes are sent to the task threads.
+// with no task thread, they are built right away
+static void buildlods(void) {
+  loop(x,world::lvl3) loop(y,world::lvl3) loop(z,world::lvl3) {
+    lodnode &n = lods[x][y][z];
+    if (n.job) {
+      if (!loadacquire(&n.job->done)) continue;
+      n.job->wait();
+      uploadlod(n, n.job->mesh);
+      n.job = nil;
+    }
+    if (!n.dirty) continue;
+    n.dirty = 0;
+    world::lodsnapshot *s = NEWE(world::lodsnapshot);
+    world::snapshot(*s, vec3i(x,y,z)*world::lvlt2);
+    n.job = NEW(lodbuildtask, s);
+    n.job->scheduled();
+    if (tasking::threadnum() != 0) continue;
+    n.job->wait();
+    uploadlod(n, n.job->mesh);
+    n.job = nil;
+  }
+}
 
-static void drawgrid(void) {
+static void cleanlods(void) {
+  loop(x,world::lvl3) loop(y,world::lvl3) loop(z,world::lvl3) {
+    lodnode &n = lods[x][y][z];
+    if (n.job) n.job->wait();
+    n.job = nil;
+    uploadlod(n, NULL);
+    n.draws.reset();
+    n.dirty = n.coarse = 0;
+  }
+  if (lodshadetex) deletetextures(1, &lodshadetex);
+  lodshadetex = 0;
+}
+
+// the distance to the node box selects the mesh with some hysteresis to avoid
+// flickering between both
+static void selectlods(void) {
+  const vec3f eye = game::viewer()->o;
+  loop(x,world::lvl3) loop(y,world::lvl3) loop(z,world::lvl3) {
+    lodnode &n = lods[x][y][z];
+    const vec3f pmin(vec3i(x,y,z)*world::lvlt2), pmax = pmin+vec3f(float(world::lvlt2));
+    const float d = length(max(max(pmin-eye, eye-pmax), vec3f(zero)));
+    if (!lod || d < float(loddist-lodhysteresis))
+      n.coarse = 0;
+    else if (d > float(loddist))
+      n.coarse = 1;
+  }
+}
+
+VAR(frustumcull,0,1,1);
+int visiblebricks = 0, culltests = 0, cullusec = 0, lodnodes = 0;
+static vector<brickref> drawlist;
+static vector<vec3i> lodlist; // lvl2 nodes drawn with their coarse mesh
+static u32 lodframe = 0;
+
+/*--------------------------------------------------------------------------
+ - frame draw list. the texture runs of all visible bricks and coarse nodes
+ - are gathered, sorted by texture and light map and submitted with as few
+ - binds as possible
+ -------------------------------------------------------------------------*/
+VAR(sortdraws,0,1,1); // if not set, draw mesh by mesh as before
+int drawcalls = 0, texturebinds = 0, poolbinds = 0;
+
+// a brick or node mesh with everything bound with it
+struct gridmesh {
+  INLINE gridmesh(void) {}
+  INLINE gridmesh(u32 slot, u32 lm, vec2f rlmdim, vec3i org) :
+    pool(world::getmeshslot(slot).pool), firstindex(world::getmeshslot(slot).firstindex),
+    lm(lm), rlmdim(rlmdim), org(org) {}
+  u32 pool, firstindex, lm;
+  vec2f rlmdim;
+  vec3i org;
+};
+
+// one texture run of a mesh. the key is (texture, pool, light map, mesh) or
+// (mesh, texture) when the draws are not sorted
+struct gridrun {
+  u64 key;
+  u32 mesh, tex, offset, n;
+};
+static vector<gridmesh> gridmeshes;
+static vector<gridrun> gridruns;
+
+static void addmesh(const gridmesh &m, const vector<vec2i> &draws) {
+  const u32 mesh = gridmeshes.size();
+  u32 offset = 0;
+  gridmeshes.add(m);
+  loopv(draws) {
+    gridrun r;
+    r.mesh = mesh;
+    r.tex = ogl::lookuptex(draws[i].y);
+    r.offset = m.firstindex+offset;
+    r.n = draws[i].x;
+    if (sortdraws)
+      r.key = (u64(r.tex)<<52) | (u64(m.pool)<<44) | (u64(m.lm)<<16) | u64(mesh);
+    else
+      r.key = (u64(mesh)<<16) | u64(r.tex);
+    gridruns.add(r);
+    offset += r.n;
+  }
+}
+
+static void bindmesh(const gridmesh &m, const gridmesh *prev) {
   using namespace world;
-  bindshader(gridshader);
-  //bindshader(DIFFUSETEX|COLOR);
-  setattribarray()(POS0, TEX0, TEX1, COL);
-  forallbricks([&](const lvl1grid &b, const vec3i org) {
-    bindbuffer(ogl::ARRAY_BUFFER, b.vbo);
-    bindbuffer(ogl::ELEMENT_ARRAY_BUFFER, b.ibo);
-    bindtexture(GL_TEXTURE_2D, 1, b.lm);
-    OGL(Uniform2fv, gridshader.u_rlmdim, 1, &b.rlmdim.x);
-    OGL(VertexAttribPointer, COL, 3, GL_FLOAT, 0, sizeof(float[10]), (const void*) sizeof(float[5]));
-    OGL(VertexAttribPointer, TEX0, 2, GL_FLOAT, 0, sizeof(float[10]), (const void*) sizeof(float[3]));
-    OGL(VertexAttribPointer, TEX1, 2, GL_FLOAT, 0, sizeof(float[10]), (const void*) sizeof(float[8]));
-    OGL(VertexAttribPointer, POS0, 3, GL_FLOAT, 0, sizeof(float[10]), (const void*) 0);
-    u32 offset = 0;
-    loopi(b.draws.size()) {
-      const auto fake = (const void*)(uintptr_t(offset*sizeof(u16)));
-      const u32 n = b.draws[i].x;
-      const u32 tex = b.draws[i].y;
-      bindgametexture(GL_TEXTURE_2D, ogl::lookuptex(tex));
-      drawelements(GL_TRIANGLES, n, GL_UNSIGNED_SHORT, fake);
-      xtraverts += n;
-      offset += n;
-    }
+  const vec3f glorg = vec3f(m.org).xzy();
+  const u32 sz = sizeof(gridvertex);
+  if (prev == NULL || prev->pool != m.pool) {
+    const meshpool &p = getmeshpool(m.pool);
+    bindbuffer(ogl::ARRAY_BUFFER, p.vbo);
+    bindbuffer(ogl::ELEMENT_ARRAY_BUFFER, p.ibo);
+    OGL(VertexAttribPointer, TEX0, 2, GL_SHORT, 0, sz, (const void*) offsetof(gridvertex,tex));
+    OGL(VertexAttribPointer, TEX1, 2, GL_UNSIGNED_SHORT, 0, sz, (const void*) offsetof(gridvertex,lm));
+    OGL(VertexAttribPointer, POS0, 3, GL_SHORT, 0, sz, (const void*) offsetof(gridvertex,pos));
+    ++poolbinds;
+  }
+  if (prev == NULL || prev->lm != m.lm) {
+    bindtexture(GL_TEXTURE_2D, 1, m.lm);
+    OGL(Uniform2fv, gridshader.u_rlmdim, 1, &m.rlmdim.x);
+  }
+  if (prev == NULL || any(prev->org != m.org))
+    OGL(Uniform3fv, gridshader.u_org, 1, &glorg.x);
+}
+
+static void drawruns(void) {
+  quicksort(gridruns.begin(), gridruns.end(), [](const gridrun &r0, const gridrun &r1) {
+    return r0.key < r1.key;
   });
+  const gridmesh *prev = NULL;
+  u32 tex = ~0u;
+  loopv(gridruns) {
+    const gridrun &r = gridruns[i];
+    const gridmesh &m = gridmeshes[r.mesh];
+    if (&m != prev) {
+      bindmesh(m, prev);
+      prev = &m;
+    }
+    if (r.tex != tex) {
+      bindgametexture(GL_TEXTURE_2D, r.tex);
+      tex = r.tex;
+      ++texturebinds;
+    }
+    const auto fake = (const void*)(uintptr_t(r.offset*sizeof(u16)));
+    drawelements(GL_TRIANGLES, r.n, GL_UNSIGNED_SHORT, fake);
+    xtraverts += r.n;
+    ++drawcalls;
+  }
+}
+
+static void drawstats(void) {
+  console::out("draws: %d runs, %d texture binds, %d pool binds (%s)",
+    drawcalls, texturebinds, poolbinds, sortdraws ? "sorted" : "unsorted");
+}
+COMMAND(drawstats, ARG_NONE);
+
+// visible bricks are first gathered by walking the world hierarchy. their
+// occluders then hide the bricks and the models behind them
+VAR(occlusioncull,0,1,1);
+VAR(occluderarea,2,8,256); // smallest rectangle of faces used as occluder
+int occludedbricks = 0, occlusionusec = 0;
+static int occlusionbricks = 0; // bricks tested against the occluders
+static void cullgrid(void) {
+  const u64 start = microseconds();
+  const mat4x4f mvp = vp[PROJECTION]*vp[MODELVIEW];
+  // bricks of the coarse nodes are replaced by the node mesh
+  const auto add = [&](world::lvl1grid &b, vec3i org) {
+    lodnode &n = getlod(org);
+    if (n.coarse && n.draws.size() != 0) {
+      if (n.frame != lodframe) lodlist.add(org/world::lvlt2);
+      n.frame = lodframe;
+    } else if (b.draws.size() != 0)
+      drawlist.add(brickref(&b, org));
+  };
+  selectlods();
+  ++lodframe;
+  drawlist.resize(0);
+  lodlist.resize(0);
+  culltests = 0;
+  if (frustumcull) {
+    const frustum fr(mvp);
+    culltests = world::forallvisiblebricks(fr, add);
+  } else
+    world::forallbricks(add);
+  cullusec = int(microseconds()-start);
+
+  occludedbricks = occlusionbricks = 0;
+  if (occlusioncull) {
+    const u64 occstart = microseconds();
+    world::beginocclusion(mvp, float(occluderarea));
+    loopv(drawlist) world::addoccluders(*drawlist[i].b);
+    s32 n = 0;
+    loopv(drawlist) {
+      const vec3i org = drawlist[i].org;
+      const vec3f pmin = vec3f(org)-vec3f(one), pmax = vec3f(org+world::brickisize)+vec3f(one);
+      if (!world::isoccluded(aabb(pmin.xzy(), pmax.xzy()))) drawlist[n++] = drawlist[i];
+    }
+    occlusionbricks = drawlist.size();
+    occludedbricks = drawlist.size()-n;
+    drawlist.resize(n);
+    n = 0;
+    loopv(lodlist) {
+      const vec3f pmin = vec3f(lodlist[i]*world::lvlt2)-vec3f(one);
+      const vec3f pmax = pmin+vec3f(float(world::lvlt2+2));
+      if (!world::isoccluded(aabb(pmin.xzy(), pmax.xzy()))) lodlist[n++] = lodlist[i];
+    }
+    lodlist.resize(n);
+    occlusionusec = int(microseconds()-occstart);
+  }
+  visiblebricks = drawlist.size();
+  lodnodes = lodlist.size();
+}
+
+static void occlusionstats(void) {
+  u32 tested, culled;
+  world::occlusionstats(tested, culled);
+  const u32 models = tested-occlusionbricks, modelculled = culled-occludedbricks;
+  console::out("occlusion: %d/%d bricks, %d/%d models culled (%.1f%%) in %d us",
+    occludedbricks, occlusionbricks, modelculled, models,
+    tested ? 100.f*float(culled)/float(tested) : 0.f, occlusionusec);
+}
+COMMAND(occlusionstats, ARG_NONE);
+
+// occlusion queries are only valid for the world view
+static void drawgrid(void) {
+  bindshader(gridshader);
+  setattribarray()(POS0, TEX0, TEX1);
+  gridmeshes.resize(0);
+  gridruns.resize(0);
+  drawcalls = texturebinds = poolbinds = 0;
+  loopv(drawlist) {
+    const world::lvl1grid &b = *drawlist[i].b;
+    addmesh(gridmesh(b.slot, b.lm, b.rlmdim, drawlist[i].org), b.draws);
+  }
+  const vec2f rlmdim = rcp(vec2f(world::lodshadedim));
+  loopv(lodlist) {
+    const vec3i idx = lodlist[i];
+    const lodnode &n = lods[idx.x][idx.y][idx.z];
+    addmesh(gridmesh(n.slot, lodshadetex, rlmdim, idx*world::lvlt2), n.draws);
+  }
+  drawruns();
+  world::endocclusion();
 }
 
 /*--------------------------------------------------------------------------
@@ -1120,6 +1672,54 @@ void drawelements(int mode, int count, int type, const void *indices) {
   OGL(DrawElements, mode, count, type, indices);
 }
 
+/*--------------------------------------------------------------------------
+ - display the world ray cast on the cpu with a screen aligned quad
+ -------------------------------------------------------------------------*/
+VAR(cpurender,0,0,1);
+static u32 cpuframetex = 0;
+static vec2i cpuframedim(zero);
+static void drawcpuframe(int w, int h, float fovy, float aspect) {
+  vec2i dim;
+  const u32 *pixels = rr::cpuframe(w, h, fovy, aspect, rr::cpubackground(), dim);
+  if (cpuframetex == 0) gentextures(1, &cpuframetex);
+  bindtexture(GL_TEXTURE_2D, 0, cpuframetex);
+  OGL(PixelStorei, GL_UNPACK_ALIGNMENT, 1);
+  if (any(dim != cpuframedim)) {
+    OGL(TexImage2D, GL_TEXTURE_2D, 0, GL_RGBA, dim.x, dim.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    cpuframedim = dim;
+  } else
+    OGL(TexSubImage2D, GL_TEXTURE_2D, 0, 0, 0, dim.x, dim.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+  // first row of the frame is the top of the screen
+  const array<float,4> verts[] = {
+    array<float,4>(0.f, 0.f, 0.f, 0.f),
+    array<float,4>(1.f, 0.f, 1.f, 0.f),
+    array<float,4>(0.f, 1.f, 0.f, 1.f),
+    array<float,4>(1.f, 1.f, 1.f, 1.f)
+  };
+  matrixmode(PROJECTION);
+  pushmatrix();
+  identity();
+  ortho(0.f, 1.f, 1.f, 0.f, -1.f, 1.f);
+  matrixmode(MODELVIEW);
+  pushmatrix();
+  identity();
+  disablev(GL_DEPTH_TEST, GL_CULL_FACE);
+  OGL(VertexAttrib4f, COL, 1.f, 1.f, 1.f, 1.f);
+  overbright(1.f);
+  bindshader(DIFFUSETEX);
+  immdraw(GL_TRIANGLE_STRIP, 2, 2, 0, 4, &verts[0][0]);
+  enablev(GL_DEPTH_TEST, GL_CULL_FACE);
+  popmatrix();
+  matrixmode(PROJECTION);
+  popmatrix();
+  matrixmode(MODELVIEW);
+}
+
 #if !defined (__WEBGL__)
 #define GL_PROC(FIELD,NAME,PROTOTYPE) PROTOTYPE FIELD = NULL;
 #include "GL/ogl100.hxx"
@@ -1133,7 +1733,9 @@ void drawelements(int mode, int count, int type, const void *indices) {
 #endif // __WEBGL__
 
 void init(int w, int h) {
-#if !defined(__WEBGL__)
+#if defined(__GLRECORD__)
+  record::install();
+#elif !defined(__WEBGL__)
 // on Windows, we directly load from OpenGL 1.1 functions
 #if defined(__WIN32__)
   #define GL_PROC(FIELD,NAME,PROTOTYPE) FIELD = (PROTOTYPE) NAME;
@@ -1182,6 +1784,15 @@ void init(int w, int h) {
   purgetextures();
   buildsphere(1, 12, 6);
 
+  // grey checker for the textures still loading
+  const u8 checker[] = {96,96,96, 160,160,160, 160,160,160, 96,96,96};
+  gentextures(1, &placeholdertex);
+  bindtexture(GL_TEXTURE_2D, 0, placeholdertex);
+  OGL(PixelStorei, GL_UNPACK_ALIGNMENT, 1);
+  OGL(TexImage2D, GL_TEXTURE_2D, 0, GL_RGB, 2, 2, 0, GL_RGB, GL_UNSIGNED_BYTE, checker);
+  OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  OGL(TexParameteri, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
   buildshaders();
 
   imminit();
@@ -1190,12 +1801,19 @@ void init(int w, int h) {
 }
 
 void clean(void) {
-  if (bvhisec) {
-    bvh::destroy(bvhisec);
-    bvhisec = NULL;
-  }
   destroyshaders();
+  if (cpuframetex) deletetextures(1, &cpuframetex);
+  cpuframetex = 0;
+  cpuframedim = vec2i(zero);
+  drawlist.reset();
+  lodlist.reset();
+  gridmeshes.reset();
+  gridruns.reset();
+  cleanlods();
+  world::destroymeshpools();
   loopi(int(IDNUM)) if (generatedids[i]) deletetextures(1, &generatedids[i]);
+  if (placeholdertex) deletetextures(1, &placeholdertex);
+  placeholdertex = 0;
   if (bigvbo) deletebuffers(1, &bigvbo);
   if (bigibo) deletebuffers(1, &bigibo);
   if (spherevbo) deletebuffers(1, &spherevbo);
@@ -1216,12 +1834,12 @@ static void setupworld(void) {
 
 static void transplayer(void) {
   identity();
-  rotate(game::player1->roll, zaxis);
-  rotate(-game::player1->pitch, xaxis);
-  rotate(game::player1->yaw, yaxis);
-  translate(vec3f(-game::player1->o.x,
-            (game::player1->state==CS_DEAD ? game::player1->eyeheight-0.2f : 0)-game::player1->o.z,
-            -game::player1->o.y));
+  rotate(game::viewer()->roll, zaxis);
+  rotate(-game::viewer()->pitch, xaxis);
+  rotate(game::viewer()->yaw, yaxis);
+  translate(vec3f(-game::viewer()->o.x,
+            (game::viewer()->state==CS_DEAD ? game::viewer()->eyeheight-0.2f : 0)-game::viewer()->o.z,
+            -game::viewer()->o.y));
 }
 
 VARP(fov, 10, 105, 120);
@@ -1238,8 +1856,8 @@ static const char *hudgunnames[] = {
 };
 
 static void drawhudmodel(int start, int end, float speed, int base) {
-  rr::rendermodel(hudgunnames[game::player1->gunselect], start, end, 0, 1.0f,
-    game::player1->o.xzy(), game::player1->yaw+90.f, game::player1->pitch,
+  rr::rendermodel(hudgunnames[game::viewer()->gunselect], start, end, 0, 1.0f,
+    game::viewer()->o.xzy(), game::viewer()->yaw+90.f, game::viewer()->pitch,
     false, 1.0f, speed, 0, base);
 }
 
@@ -1252,11 +1870,11 @@ static void drawhudgun(float fovy, float aspect, int farplane) {
   perspective(fovy, aspect, 0.3f, float(farplane));
   matrixmode(MODELVIEW);
 
-  const int rtime = game::reloadtime(game::player1->gunselect);
-  if (game::player1->lastaction &&
-      game::player1->lastattackgun==game::player1->gunselect &&
-      game::lastmillis()-game::player1->lastaction<rtime)
-    drawhudmodel(7, 18, rtime/18.0f, game::player1->lastaction);
+  const int rtime = game::reloadtime(game::viewer()->gunselect);
+  if (game::viewer()->lastaction &&
+      game::viewer()->lastattackgun==game::viewer()->gunselect &&
+      game::lastmillis()-game::viewer()->lastaction<rtime)
+    drawhudmodel(7, 18, rtime/18.0f, game::viewer()->lastaction);
   else
     drawhudmodel(6, 1, 100, 0);
 
@@ -1307,22 +1925,59 @@ static void dofog(bool underwater) {
 VAR(wireframe,0,0,1);
 VAR(rendermonsters,0,1,1);
 
+#if defined(__GLRECORD__)
+// what the recorder saw during the last frame. scripted headless runs quit
+// once glrecordframes frames are drawn
+VAR(glrecordframes, 0, 0, 1<<30);
+static void glstats(void) {
+  const record::stats &s = record::frame();
+  console::out("gl: %u draws, %u elements, %u states, %u uniforms, %u attribs",
+    s.draws, s.elements, s.states, s.uniforms, s.attribs);
+  console::out("gl: %u program, %u texture and %u buffer binds (%u redundant)",
+    s.programs, s.textures, s.buffers, s.redundant);
+  console::out("gl: %u KB uploaded, %u KB of buffers, %u KB of textures",
+    u32(s.uploaded/KB), u32(record::buffermemory()/KB), u32(record::texturememory()/KB));
+}
+COMMAND(glstats, ARG_NONE);
+
+static void recordframe(void) {
+  static int framenum = 0;
+  if (glrecordframes == 0 || ++framenum < glrecordframes) return;
+  glstats();
+  cmd::execute("quit");
+}
+#endif // __GLRECORD__
+
 void drawframe(int w, int h, float curfps) {
   const float hf = world::waterlevel()-0.3f;
-  const bool underwater = game::player1->o.z<hf;
+  const bool underwater = game::viewer()->o.z<hf;
   float fovy = float(fov)*float(h)/float(w);
   float aspect = float(w)/float(h);
 
-  buildgrid();
+#if defined(__GLRECORD__)
+  record::beginframe();
+#endif // __GLRECORD__
+  buildlods();
+  uploadmeshes();
+  flushmeshpools();
+  refinelightmaps();
   forceglstate();
   dofog(underwater);
-  OGL(Clear, (game::player1->outsidemap ? GL_COLOR_BUFFER_BIT : 0) | GL_DEPTH_BUFFER_BIT);
+  OGL(Clear, (game::viewer()->outsidemap ? GL_COLOR_BUFFER_BIT : 0) | GL_DEPTH_BUFFER_BIT);
 
   if (underwater) {
     fovy += sin(game::lastmillis()/1000.f)*2.0f;
     aspect += sin(game::lastmillis()/1000.f+float(pi))*0.1f;
   }
   const int farplane = fog*5/2;
+  if (cpurender) {
+    OGL(Clear, GL_COLOR_BUFFER_BIT);
+    drawcpuframe(w, h, fovy, aspect);
+    overbright(1.f);
+    rr::drawhud(w, h, int(curfps), 0, rr::curvert, underwater);
+    enablev(GL_CULL_FACE);
+    return;
+  }
   matrixmode(PROJECTION);
   identity();
   perspective(fovy, aspect, 0.15f, float(farplane));
@@ -1332,8 +1987,8 @@ void drawframe(int w, int h, float curfps) {
   // render sky
   if (rendersky) {
     identity();
-    rotate(-game::player1->pitch, xaxis);
-    rotate(game::player1->yaw, yaxis);
+    rotate(-game::viewer()->pitch, xaxis);
+    rotate(game::viewer()->yaw, yaxis);
     rotate(90.f, vec3f(1.f,0.f,0.f));
     OGL(VertexAttrib3f,COL,1.0f,1.0f,1.0f);
     rr::drawenvbox(14, fog*4/3);
@@ -1341,13 +1996,14 @@ void drawframe(int w, int h, float curfps) {
   transplayer();
   overbright(2.f);
   setupworld();
+  cullgrid();
   bindshader(DIFFUSETEX|FOG);
 
   ogl::xtraverts = 0;
   game::renderclients();
   if (rendermonsters) game::monsterrender();
   game::renderentities();
-  rr::renderspheres(game::curtime());
+  rr::renderspheres();
   rr::renderents();
   enablev(GL_CULL_FACE);
   IF_NOT_WEBGL(OGL(PolygonMode, GL_FRONT_AND_BACK, wireframe?GL_LINE:GL_FILL));
@@ -1365,12 +2021,15 @@ void drawframe(int w, int h, float curfps) {
   if (renderparticles) {
     overbright(2.f);
     bindshader(DIFFUSETEX);
-    rr::render_particles(game::curtime());
+    rr::render_particles();
   }
 
   overbright(1.f);
   rr::drawhud(w, h, int(curfps), nquads, rr::curvert, underwater);
   enablev(GL_CULL_FACE);
+#if defined(__GLRECORD__)
+  recordframe();
+#endif // __GLRECORD__
 }
 
 } // namespace ogl
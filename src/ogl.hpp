@@ -113,7 +113,12 @@ void deletebuffers(s32 n, u32 *id);
 void init(int w, int h);
 void clean(void);
 void drawframe(int w, int h, float curfps);
+// rebuild the dirty bricks, the bvh and the light maps. the simulation traces
+// the bvh: it must not run meanwhile
+void buildworld(void);
 bool installtex(int id, const char *name, int &xs, int &ys, bool clamp = false);
+// load the texture asynchronously. a placeholder is bound until it is ready
+void requesttex(int id, const char *name, bool clamp = false);
 int lookuptex(int tex, int &xs, int &ys);
 INLINE int lookuptex(int tex) {int xs,ys; return lookuptex(tex,xs,ys);}
 
@@ -181,6 +186,22 @@ const mat4x4f &matrix(int mode);
 
 // number of transformed vertices per frame
 extern int xtraverts;
+// bricks drawn, hierarchy nodes tested and time spent in the last grid draw
+extern int visiblebricks, culltests, cullusec;
+// lvl2 nodes drawn with their coarse mesh
+extern int lodnodes;
+// bricks hidden by the occluders and time spent in the occlusion culling
+extern int occludedbricks, occlusionusec;
+// draw calls, game texture binds and mesh pool binds of the last grid draw
+extern int drawcalls, texturebinds, poolbinds;
+
+// cpu light map (and its pending refinement) attached to a brick
+struct lightmapbake;
+void destroylightmapbake(lightmapbake *bake);
+// light map texel (rgba) at point p of the given cube face. white if none
+u32 lightmaptexel(const lightmapbake *bake, const vec3i &xyz, u32 face, const vec3f &p);
+// name of the texture bound to the given map slot (null if none)
+const char *texturename(int tex);
 
 } // namespace ogl
 } // namespace cube
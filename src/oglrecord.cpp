@@ -0,0 +1,224 @@
+#include "oglrecord.hpp"
+#include "ogl.hpp"
+
+namespace cube {
+namespace ogl {
+namespace record {
+
+static stats cur, tot;
+static vector<u64> buffersizes, texturesizes; // indexed by gl name
+static u32 boundbuffers[2], boundtextures[32], activetexture = 0;
+static u32 boundprogram = 0, nextname = 1;
+static GLint viewport[4] = {0,0,0,0};
+
+static void accumulate(stats &dst, const stats &src) {
+  dst.draws += src.draws;
+  dst.elements += src.elements;
+  dst.states += src.states;
+  dst.programs += src.programs;
+  dst.textures += src.textures;
+  dst.buffers += src.buffers;
+  dst.redundant += src.redundant;
+  dst.uniforms += src.uniforms;
+  dst.attribs += src.attribs;
+  dst.uploaded += src.uploaded;
+}
+
+void beginframe(void) {
+  accumulate(tot, cur);
+  cur = stats();
+}
+const stats &frame(void) { return cur; }
+stats total(void) {
+  stats s = tot;
+  accumulate(s, cur);
+  return s;
+}
+
+static u64 sum(const vector<u64> &sizes) {
+  u64 n = 0;
+  loopv(sizes) n += sizes[i];
+  return n;
+}
+u64 buffermemory(void) { return sum(buffersizes); }
+u64 texturememory(void) { return sum(texturesizes); }
+
+/*-------------------------------------------------------------------------
+ - the stubs. by default, a gl function does nothing and returns zero. some
+ - of them are only counted and the others track the gl objects
+ -------------------------------------------------------------------------*/
+template <typename T> struct stub;
+template <typename R, typename... Args> struct stub<R (APIENTRYP)(Args...)> {
+  static R APIENTRY call(Args...) { return R(); }
+};
+template <typename T, u32 stats::*field> struct counted;
+template <typename R, typename... Args, u32 stats::*field>
+struct counted<R (APIENTRYP)(Args...), field> {
+  static R APIENTRY call(Args...) { ++(cur.*field); return R(); }
+};
+
+static u64 &objectsize(vector<u64> &sizes, u32 name) {
+  while (u32(sizes.size()) <= name) sizes.add(0);
+  return sizes[name];
+}
+static void APIENTRY gennames(GLsizei n, GLuint *names) {
+  loopi(n) names[i] = nextname++;
+}
+static void APIENTRY deletebuffers(GLsizei n, const GLuint *names) {
+  loopi(n) objectsize(buffersizes, names[i]) = 0;
+}
+static void APIENTRY deletetextures(GLsizei n, const GLuint *names) {
+  loopi(n) objectsize(texturesizes, names[i]) = 0;
+}
+static u32 buffertarget(GLenum target) { return target == GL_ARRAY_BUFFER ? 0 : 1; }
+static void APIENTRY bindbuffer(GLenum target, GLuint name) {
+  u32 &bound = boundbuffers[buffertarget(target)];
+  ++cur.buffers;
+  if (bound == name) ++cur.redundant;
+  bound = name;
+}
+static void APIENTRY bufferdata(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage) {
+  objectsize(buffersizes, boundbuffers[buffertarget(target)]) = u64(size);
+  if (data) cur.uploaded += u64(size);
+}
+static void APIENTRY buffersubdata(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data) {
+  cur.uploaded += u64(size);
+}
+static void APIENTRY activetex(GLenum unit) {
+  activetexture = min(u32(unit-GL_TEXTURE0), u32(ARRAY_ELEM_N(boundtextures))-1);
+}
+static void APIENTRY bindtexture(GLenum target, GLuint name) {
+  u32 &bound = boundtextures[activetexture];
+  ++cur.textures;
+  if (bound == name) ++cur.redundant;
+  bound = name;
+}
+static u64 texelsize(GLenum format, GLenum type) {
+  u64 channels = 4;
+  switch (format) {
+    case GL_RGB: channels = 3; break;
+    case GL_RED: case GL_ALPHA: case GL_DEPTH_COMPONENT: channels = 1; break;
+    case GL_RG: channels = 2; break;
+  }
+  const u64 bytes = type == GL_FLOAT ? 4 : (type == GL_UNSIGNED_SHORT ? 2 : 1);
+  return channels*bytes;
+}
+static void APIENTRY teximage2d(GLenum target, GLint level, GLint internalformat, GLsizei w,
+                                GLsizei h, GLint border, GLenum format, GLenum type,
+                                const GLvoid *pixels) {
+  const u64 size = u64(w)*u64(h)*texelsize(format, type);
+  if (level == 0) objectsize(texturesizes, boundtextures[activetexture]) = size;
+  if (pixels) cur.uploaded += size;
+}
+static void APIENTRY texsubimage2d(GLenum target, GLint level, GLint x, GLint y, GLsizei w,
+                                   GLsizei h, GLenum format, GLenum type, const GLvoid *pixels) {
+  cur.uploaded += u64(w)*u64(h)*texelsize(format, type);
+}
+static void APIENTRY drawelements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices) {
+  ++cur.draws;
+  cur.elements += count;
+}
+static void APIENTRY drawarrays(GLenum mode, GLint first, GLsizei count) {
+  ++cur.draws;
+  cur.elements += count;
+}
+static GLuint APIENTRY createshader(GLenum type) { return nextname++; }
+static GLuint APIENTRY createprogram(void) { return nextname++; }
+static void APIENTRY useprogram(GLuint program) {
+  ++cur.programs;
+  if (boundprogram == program) ++cur.redundant;
+  boundprogram = program;
+}
+// shaders always compile with no log
+static void APIENTRY getshaderiv(GLuint name, GLenum pname, GLint *params) {
+  *params = (pname == GL_COMPILE_STATUS || pname == GL_LINK_STATUS) ? GL_TRUE : 0;
+}
+static void APIENTRY setviewport(GLint x, GLint y, GLsizei w, GLsizei h) {
+  ++cur.states;
+  viewport[0] = x; viewport[1] = y;
+  viewport[2] = w; viewport[3] = h;
+}
+static void APIENTRY getintegerv(GLenum pname, GLint *params) {
+  if (pname == GL_VIEWPORT)
+    loopi(4) params[i] = viewport[i];
+  else if (pname == GL_MAX_TEXTURE_SIZE)
+    *params = 4096;
+  else
+    *params = 0;
+}
+
+void install(void) {
+#define GL_PROC(FIELD,NAME,PROTOTYPE) FIELD = stub<PROTOTYPE>::call;
+#include "GL/ogl100.hxx"
+#include "GL/ogl110.hxx"
+#include "GL/ogl120.hxx"
+#include "GL/ogl130.hxx"
+#include "GL/ogl150.hxx"
+#include "GL/ogl200.hxx"
+#include "GL/ogl300.hxx"
+#undef GL_PROC
+
+#define COUNT(NAME, FIELD) NAME = counted<decltype(NAME), &stats::FIELD>::call;
+  COUNT(Enable, states);
+  COUNT(Disable, states);
+  COUNT(BlendFunc, states);
+  COUNT(DepthMask, states);
+  COUNT(DepthFunc, states);
+  COUNT(CullFace, states);
+  COUNT(FrontFace, states);
+  COUNT(PolygonMode, states);
+  COUNT(LineWidth, states);
+  COUNT(ColorMask, states);
+  COUNT(Scissor, states);
+  COUNT(Uniform1f, uniforms);
+  COUNT(Uniform2f, uniforms);
+  COUNT(Uniform3f, uniforms);
+  COUNT(Uniform4f, uniforms);
+  COUNT(Uniform1i, uniforms);
+  COUNT(Uniform1fv, uniforms);
+  COUNT(Uniform2fv, uniforms);
+  COUNT(Uniform3fv, uniforms);
+  COUNT(Uniform4fv, uniforms);
+  COUNT(UniformMatrix4fv, uniforms);
+  COUNT(VertexAttribPointer, attribs);
+  COUNT(EnableVertexAttribArray, attribs);
+  COUNT(DisableVertexAttribArray, attribs);
+  COUNT(VertexAttrib3f, attribs);
+  COUNT(VertexAttrib3fv, attribs);
+  COUNT(VertexAttrib4f, attribs);
+  COUNT(VertexAttrib4fv, attribs);
+#undef COUNT
+  GenBuffers = gennames;
+  GenTextures = gennames;
+  DeleteBuffers = deletebuffers;
+  DeleteTextures = deletetextures;
+  BindBuffer = bindbuffer;
+  BufferData = bufferdata;
+  BufferSubData = buffersubdata;
+  ActiveTexture = activetex;
+  BindTexture = bindtexture;
+  TexImage2D = teximage2d;
+  TexSubImage2D = texsubimage2d;
+  DrawElements = drawelements;
+  DrawArrays = drawarrays;
+  CreateShader = createshader;
+  CreateProgram = createprogram;
+  UseProgram = useprogram;
+  GetShaderiv = getshaderiv;
+  GetProgramiv = getshaderiv;
+  Viewport = setviewport;
+  GetIntegerv = getintegerv;
+
+  cur = tot = stats();
+  MEMZERO(boundbuffers);
+  MEMZERO(boundtextures);
+  activetexture = boundprogram = 0;
+  nextname = 1;
+  buffersizes.reset();
+  texturesizes.reset();
+}
+
+} // namespace record
+} // namespace ogl
+} // namespace cube
+
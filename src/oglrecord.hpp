@@ -0,0 +1,42 @@
+#pragma once
+#include "base/tools.hpp"
+
+namespace cube {
+namespace ogl {
+namespace record {
+
+/*-------------------------------------------------------------------------
+ - headless opengl backend: every gl function is replaced by a stub that
+ - only records what the renderer asks for. no gpu is needed. the client uses
+ - it when built with __GLRECORD__ (OGL_RECORDER in cmake)
+ -------------------------------------------------------------------------*/
+
+// what was recorded during a frame
+struct stats {
+  u32 draws; // draw calls
+  u32 elements; // vertices or indices sent by the draw calls
+  u32 states; // enable, disable, blending, depth, culling... calls
+  u32 programs; // program binds
+  u32 textures; // texture binds
+  u32 buffers; // buffer binds
+  u32 redundant; // binds of an object already bound
+  u32 uniforms; // uniform updates
+  u32 attribs; // vertex attribute setups
+  u64 uploaded; // bytes sent to buffers and textures
+};
+
+// replace all gl function pointers by the recorder ones
+void install(void);
+// start a new frame
+void beginframe(void);
+// stats since the last beginframe and since install
+const stats &frame(void);
+stats total(void);
+// bytes currently held by the live buffers and textures
+u64 buffermemory(void);
+u64 texturememory(void);
+
+} // namespace record
+} // namespace ogl
+} // namespace cube
+
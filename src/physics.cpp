@@ -45,8 +45,9 @@ namespace physics {
   static bool mapcollide(const aabb &box) {
     const auto pmin = vec3i(box.pmin)-vec3i(one);
     const auto pmax = vec3i(box.pmax)+vec3i(one);
+    if (!world::anyoccupied(pmin, pmax)) return true;
     loopxyz(pmin, pmax,
-      if (world::getcube(xyz).mat != world::EMPTY && intersect(getaabb(xyz), box))
+      if (world::occupied(xyz) && intersect(getaabb(xyz), box))
         return false;);
     return true;
   }
@@ -0,0 +1,236 @@
+#include "cube.hpp"
+#include "base/task.hpp"
+#include <SDL/SDL.h>
+#include <SDL/SDL_image.h>
+
+namespace cube {
+namespace ogl { extern int fov, fogcolour; }
+namespace rr {
+
+/*--------------------------------------------------------------------------
+ - cpu copies of the map textures
+ -------------------------------------------------------------------------*/
+struct cputexture {
+  INLINE cputexture(void) : dim(zero) { name[0] = '\0'; }
+  string name;
+  vec2i dim;
+  vector<u32> texels;
+};
+static cputexture cputex[ogl::MAXMAPTEX];
+
+static void loadcputexture(cputexture &tex, const char *name) {
+  strcpy_s(tex.name, name);
+  tex.texels.resize(0);
+  tex.dim = vec2i(one);
+  sprintf_sd(filename)("packages%c%s", PATHDIV, name);
+  SDL_Surface *s = name[0] ? IMG_Load(filename) : NULL;
+  const int bpp = s ? s->format->BytesPerPixel : 0;
+  if (bpp == 3 || bpp == 4) {
+    tex.dim = vec2i(s->w, s->h);
+    tex.texels.resize(s->w*s->h);
+    loopi(s->h) loopj(s->w) {
+      const u8 *src = (const u8*) s->pixels + i*s->pitch + j*bpp;
+      tex.texels[i*s->w+j] = src[0] | (src[1]<<8) | (src[2]<<16) | 0xff000000;
+    }
+  } else
+    tex.texels.add(0xffffffff);
+  if (s) SDL_FreeSurface(s);
+}
+
+// textures are resolved once per frame since the threads only read them
+static void updatecputextures(void) {
+  loopi(ogl::MAXMAPTEX) {
+    const char *name = ogl::texturename(i);
+    if (name == NULL) name = "";
+    if (strcmp(name, cputex[i].name) != 0 || cputex[i].texels.size() == 0)
+      loadcputexture(cputex[i], name);
+  }
+}
+
+static INLINE int wrap(int x, int n) { return ((x%n)+n)%n; }
+
+static INLINE u32 modulate(u32 a, u32 b) {
+  u32 c = 0xff000000;
+  loopi(3) {
+    const u32 shift = 8*i;
+    c |= ((((a>>shift)&0xff)*((b>>shift)&0xff))/255)<<shift;
+  }
+  return c;
+}
+
+/*--------------------------------------------------------------------------
+ - shade one hit point exactly as the grid shader does (texture*light map)
+ -------------------------------------------------------------------------*/
+static u32 shade(const vec3f &org, const vec3f &dir, float t) {
+  const vec3f p = org + t*dir;
+
+  // the hit face is orthogonal to the axis where p is the closest to the grid.
+  // deformed cubes are shaded as their closest axis aligned face
+  int axis = 0;
+  float best = FLT_MAX;
+  loopi(3) {
+    const float d = abs(p[i]-floor(p[i]+0.5f));
+    if (d < best) {
+      best = d;
+      axis = i;
+    }
+  }
+  const u32 face = 2*axis + (dir[axis] < 0.f ? 1 : 0);
+  const vec3i xyz(floor(p+1e-3f*dir));
+
+  // diffuse texture repeats once per cube
+  const world::brickcube c = world::getcube(xyz);
+  const cputexture &tex = cputex[min(s32(c.tex[face]), ogl::MAXMAPTEX-1)];
+  const vec2f st = axis==0 ? p.yz() : (axis==1 ? p.xz() : p.xy());
+  const int x = wrap(int(floor(st.x*float(tex.dim.x))), tex.dim.x);
+  const int y = wrap(int(floor(st.y*float(tex.dim.y))), tex.dim.y);
+  const u32 diffuse = tex.texels[y*tex.dim.x+x];
+
+  const world::lvl1grid *b = world::getbrick(xyz);
+  const u32 lm = ogl::lightmaptexel(b ? b->bake : NULL, xyz, face, p);
+  return modulate(diffuse, lm);
+}
+
+/*--------------------------------------------------------------------------
+ - tiles of pixels are traced as ray packets in parallel
+ -------------------------------------------------------------------------*/
+static const int TILESIZE = 16;
+
+struct cpurendertask : public task {
+  cpurendertask(const camera &cam, u32 *pixels, vec2i dim, vec2i tile, u32 background) :
+    task("cpurendertask", tile.x*tile.y, 1, 0, UNFAIR),
+    cam(cam), pixels(pixels), dim(dim), tile(tile), background(background) {}
+  virtual void run(u32 tileid) {
+    const vec2i screen = TILESIZE*vec2i(tileid%tile.x, tileid/tile.x);
+    const bvh::intersector *bvhisec = world::getbvh();
+
+    // pixels outside the screen replicate the border ones
+    raypacket p;
+    float tnear[TILESIZE*TILESIZE];
+    vec3f mindir(FLT_MAX), maxdir(-FLT_MAX);
+    loopi(TILESIZE) loopj(TILESIZE) {
+      const vec2i xy = min(screen+vec2i(j,i), dim-vec2i(one));
+      const ray r = cam.generate(dim.x, dim.y, xy.x, xy.y);
+      const int idx = j+i*TILESIZE;
+      p.setorg(cam.org, idx);
+      p.setdir(r.dir, idx);
+      mindir = min(mindir, r.dir);
+      maxdir = max(maxdir, r.dir);
+      if (bvhisec == NULL) {
+        const isecres res = world::castray(r);
+        tnear[idx] = res.isec ? res.t : FLT_MAX;
+      }
+    }
+    if (bvhisec) {
+      p.raynum = TILESIZE*TILESIZE;
+      p.flags = raypacket::COMMONORG;
+      if (all(mindir*maxdir > vec3f(zero))) {
+        p.iadir = makeinterval(mindir, maxdir);
+        p.iardir = rcp(p.iadir);
+        p.iaorg = makeinterval(cam.org, cam.org);
+        p.flags |= raypacket::INTERVALARITH;
+      }
+      bvh::packethit hit;
+      bvh::closest(*bvhisec, p, hit);
+      loopi(TILESIZE*TILESIZE) tnear[i] = hit[i].is_hit() ? hit[i].t : FLT_MAX;
+    }
+
+    loopi(TILESIZE) loopj(TILESIZE) {
+      const vec2i xy = screen+vec2i(j,i);
+      if (any(xy >= dim)) continue;
+      const int idx = j+i*TILESIZE;
+      u32 &pixel = pixels[xy.x+xy.y*dim.x];
+      if (tnear[idx] < FLT_MAX)
+        pixel = shade(cam.org, p.dir(idx), tnear[idx]);
+      else
+        pixel = background;
+    }
+  }
+  const camera &cam;
+  u32 *pixels;
+  vec2i dim, tile;
+  u32 background;
+};
+
+camera cpucamera(float fovy, float aspect) {
+  const mat3x3f r = mat3x3f::rotate(vec3f(0.f,0.f,1.f),game::viewer()->yaw)*
+                    mat3x3f::rotate(vec3f(0.f,1.f,0.f),game::viewer()->roll)*
+                    mat3x3f::rotate(vec3f(-1.f,0.f,0.f),game::viewer()->pitch);
+  return camera(game::viewer()->o, -r.vz, -r.vy, fovy, aspect);
+}
+
+void cpurender(u32 *pixels, vec2i dim, const camera &cam, u32 background) {
+  updatecputextures();
+  const vec2i tile = (dim+vec2i(TILESIZE-1))/TILESIZE;
+  ref<task> job = NEW(cpurendertask, cam, pixels, dim, tile, background);
+  job->scheduled();
+  job->wait();
+}
+
+/*--------------------------------------------------------------------------
+ - adaptive resolution: the frame is scaled down until we meet the budget
+ -------------------------------------------------------------------------*/
+VAR(cpumsec, 1, 33, 1000); // target time per frame
+VAR(cpuadaptive, 0, 1, 1);
+VAR(cpuscale, 1, 1, 16); // screen to frame ratio when not adaptive
+static float adaptivescale = 1.f;
+static vector<u32> cpupixels;
+
+const u32 *cpuframe(int w, int h, float fovy, float aspect, u32 background, vec2i &dim) {
+  const float scale = cpuadaptive ? adaptivescale : float(cpuscale);
+  dim = vec2i(max(int(float(w)/scale),1), max(int(float(h)/scale),1));
+  cpupixels.resize(dim.x*dim.y);
+  const int start = SDL_GetTicks();
+  cpurender(cpupixels.data(), dim, cpucamera(fovy, aspect), background);
+  const int msec = max(int(SDL_GetTicks())-start, 1);
+
+  // the cost is linear with the pixel number i.e. quadratic with the scale
+  if (cpuadaptive) {
+    const float ideal = scale*sqrt(float(msec)/float(cpumsec));
+    adaptivescale = clamp(0.75f*scale+0.25f*ideal, 1.f, 16.f);
+  }
+  return cpupixels.data();
+}
+
+u32 cpubackground(void) {
+  const u32 c = ogl::fogcolour;
+  return 0xff000000 | ((c>>16)&0xff) | (c&0xff00) | ((c&0xff)<<16);
+}
+
+// headless benchmark: render frames at the given resolution and save the last
+// one with the same orientation as a screenshot
+static void cpubench(int n, int w, int h) {
+  n = max(n, 1);
+  if (w <= 0 || h <= 0) {
+    w = 640;
+    h = 480;
+  }
+  vector<u32> pixels(w*h);
+  const float fovy = float(ogl::fov)*float(h)/float(w);
+  const camera cam = cpucamera(fovy, float(w)/float(h));
+  const int start = SDL_GetTicks();
+  loopi(n) cpurender(pixels.data(), vec2i(w,h), cam, cpubackground());
+  const int msec = max(int(SDL_GetTicks())-start, 1);
+  console::out("cpubench: %i frames (%ix%i) in %i ms: %f ms/frame, %f Mrays/s",
+    n, w, h, msec, float(msec)/float(n), float(n)*float(w*h)/(1000.f*float(msec)));
+
+  SDL_Surface *image = SDL_CreateRGBSurfaceFrom(pixels.data(), w, h, 32, 4*w,
+    0x000000ff, 0x0000ff00, 0x00ff0000, 0);
+  if (image == NULL) return;
+  sprintf_sd(buf)("screenshots/cpubench_%d.bmp", game::lastmillis());
+  SDL_SaveBMP(image, path(buf));
+  SDL_FreeSurface(image);
+}
+COMMAND(cpubench, ARG_3INT);
+
+void cleanrendercpu(void) {
+  loopi(ogl::MAXMAPTEX) {
+    cputex[i].texels.reset();
+    cputex[i].name[0] = '\0';
+  }
+  cpupixels.reset();
+}
+
+} // namespace rr
+} // namespace cube
+
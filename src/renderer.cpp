@@ -7,6 +7,7 @@ int curmaxverts = 10000;
 void clean(void) {
   mapmodelreset();
   cleanparticles();
+  cleanrendercpu();
 }
 } // namespace rr
 } // namespace cube
@@ -25,7 +25,11 @@ void box(const vec3i &start, const vec3i &size, const vec3f &col);
 void dot(int x, int y, float z);
 void linestyle(float width, int r, int g, int b);
 void newsphere(const vec3f &o, float max, int type);
-void renderspheres(int time);
+// move the spheres. done by the simulation
+void updatespheres(int time);
+// copy the spheres for the renderer
+void snapshotspheres(void);
+void renderspheres(void);
 void drawhud(int w, int h, int curfps, int nquads, int curvert, bool underwater);
 void readdepth(int w, int h);
 void blendbox(int x1, int y1, int x2, int y2, bool border);
@@ -36,11 +40,24 @@ void renderents(void);
 void setorient(const vec3f &r, const vec3f &u);
 void particle_splash(int type, int num, int fade, const vec3f &p);
 void particle_trail(int type, int fade, const vec3f &from, const vec3f &to);
-void render_particles(int time);
+// move and expire the particles. done by the simulation
+void updateparticles(int time);
+// copy the particles for the renderer
+void snapshotparticles(void);
+void render_particles(void);
 void cleanparticles(void);
 
+// rendercpu: ray cast the world with the task threads (no opengl involved)
+camera cpucamera(float fovy, float aspect);
+void cpurender(u32 *pixels, vec2i dim, const camera &cam, u32 background);
+const u32 *cpuframe(int w, int h, float fovy, float aspect, u32 background, vec2i &dim);
+u32 cpubackground(void);
+void cleanrendercpu(void);
+
 // rendermd2
-void rendermodel(const char *mdl, int frame, int range, int tex, float rad, const vec3f &o, float yaw, float pitch, bool teammate, float scale, float speed, int snap = 0, int basetime = 0);
+// height is the extent above o of models standing on it (map models). 0 if o
+// is the model center
+void rendermodel(const char *mdl, int frame, int range, int tex, float rad, const vec3f &o, float yaw, float pitch, bool teammate, float scale, float speed, int snap = 0, int basetime = 0, float height = 0.f);
 game::mapmodelinfo &getmminfo(int i);
 void mapmodelreset(void);
 
@@ -103,13 +103,35 @@ void newsphere(const vec3f &o, float max, int type) {
   }
 }
 
-void renderspheres(int time) {
+void updatespheres(int time) {
+  for (sphere *p, **pp = &slist; (p = *pp);) {
+    if (p->size>p->max) {
+      *pp = p->next;
+      p->next = sempty;
+      sempty = p;
+    } else {
+      p->size += time/100.0f;
+      pp = &p->next;
+    }
+  }
+}
+
+// spheres as they were when the snapshot was taken
+static vector<sphere> drawnspheres;
+
+void snapshotspheres(void) {
+  drawnspheres.clear();
+  for (sphere *p = slist; p; p = p->next) drawnspheres.add(*p);
+}
+
+void renderspheres(void) {
   ogl::enablev(GL_BLEND);
   OGL(DepthMask, GL_FALSE);
   OGL(BlendFunc, GL_SRC_ALPHA, GL_ONE);
   ogl::bindgametexture(GL_TEXTURE_2D, 4);
 
-  for (sphere *p, **pp = &slist; (p = *pp);) {
+  loopv(drawnspheres) {
+    const sphere *p = &drawnspheres[i];
     const float size = p->size/p->max;
     ogl::pushmatrix();
     OGL(VertexAttrib4f, ogl::COL, 1.0f, 1.0f, 1.0f, 1.0f-size);
@@ -121,15 +143,6 @@ void renderspheres(int time) {
     ogl::drawsphere();
     ogl::popmatrix();
     ogl::xtraverts += 12*6*2;
-
-    if (p->size>p->max) {
-      *pp = p->next;
-      p->next = sempty;
-      sempty = p;
-    } else {
-      p->size += time/100.0f;
-      pp = &p->next;
-    }
   }
 
   ogl::disablev(GL_BLEND);
@@ -138,16 +151,10 @@ void renderspheres(int time) {
 
 static string closeent;
 
-// show sparkly thingies for map entities in edit mode
+// name the closest entity in edit mode. its sparkles are particles
 void renderents(void) {
   closeent[0] = 0;
   if (!edit::mode()) return;
-  loopv(game::ents) {
-    game::entity &e = game::ents[i];
-    if (e.type==game::NOTUSED) continue;
-    vec3f v(float(e.x), float(e.y), float(e.z));
-    particle_splash(2, 2, 40, v);
-  }
   const int e = world::closestent();
   if (e>=0) {
     game::entity &c = game::ents[e];
@@ -165,9 +172,7 @@ static void loadsky(char *basename) {
   const int texnum = 14;
   loopi(6) {
     sprintf_sd(name)("packages/%s_%s.jpg", basename, side[i]);
-    int xs, ys;
-    if (!ogl::installtex(texnum+i, path(name), xs, ys, true))
-      console::out("could not load sky textures");
+    ogl::requesttex(texnum+i, path(name), true);
   }
   strcpy_s(lastsky, basename);
 }
@@ -238,7 +243,7 @@ VARP(crosshairfx, 0, 1, 1);
 void drawhud(int w, int h, int curfps, int nquads, int curvert, bool underwater) {
   readmatrices();
   if (edit::mode()) {
-    if (cursordepth==1.0f) game::setworldpos(game::player1->o);
+    if (cursordepth==1.0f) game::setworldpos(game::viewer()->o);
     edit::cursorupdate();
   }
   ogl::disablev(GL_DEPTH_TEST);
@@ -281,11 +286,11 @@ void drawhud(int w, int h, int curfps, int nquads, int curvert, bool underwater)
     ogl::bindgametexture(GL_TEXTURE_2D, 1);
     OGL(VertexAttrib3f,ogl::COL,1.f,1.f,1.f);
     if (crosshairfx) {
-      if (game::player1->gunwait)
+      if (game::viewer()->gunwait)
         OGL(VertexAttrib3f,ogl::COL,0.5f,0.5f,0.5f);
-      else if (game::player1->health<=25)
+      else if (game::viewer()->health<=25)
         OGL(VertexAttrib3f,ogl::COL,1.0f,0.0f,0.0f);
-      else if (game::player1->health<=50)
+      else if (game::viewer()->health<=50)
         OGL(VertexAttrib3f,ogl::COL,1.0f,0.5f,0.0f);
     }
     const float csz = float(crosshairsize);
@@ -305,32 +310,37 @@ void drawhud(int w, int h, int curfps, int nquads, int curvert, bool underwater)
   console::render();
 
   if (!hidestats) {
-    const vec3f &o = game::player1->o;
+    const vec3f &o = game::viewer()->o;
     ogl::popmatrix();
     ogl::pushmatrix();
     ogl::ortho(0.f,VIRTW*3.f/2.f,VIRTH*3.f/2.f,0.f,-1.f,1.f);
-    drawtextf("pos %d %d %d", 3100, 2320, 2, int(o.x), int(o.y), int(o.z));
-    drawtextf("fps %d", 3000, 2390, 2, curfps);
-    drawtextf("wqd %d", 3000, 2460, 2, nquads);
-    drawtextf("wvt %d", 3000, 2530, 2, curvert);
-    drawtextf("evt %d", 3000, 2600, 2, ogl::xtraverts);
+    drawtextf("pos %d %d %d", 3100, 1970, 2, int(o.x), int(o.y), int(o.z));
+    drawtextf("fps %d", 3000, 2040, 2, curfps);
+    drawtextf("wqd %d", 3000, 2110, 2, nquads);
+    drawtextf("wvt %d", 3000, 2180, 2, curvert);
+    drawtextf("evt %d", 3000, 2250, 2, ogl::xtraverts);
+    drawtextf("bck %d", 3000, 2320, 2, ogl::visiblebricks);
+    drawtextf("cul %dus", 3000, 2390, 2, ogl::cullusec);
+    drawtextf("occ %d %dus", 3000, 2460, 2, ogl::occludedbricks, ogl::occlusionusec);
+    drawtextf("lod %d", 3000, 2530, 2, ogl::lodnodes);
+    drawtextf("drw %d %d", 3000, 2600, 2, ogl::drawcalls, ogl::texturebinds);
   }
 
   ogl::popmatrix();
 
-  if (game::player1->state==CS_ALIVE) {
+  if (game::viewer()->state==CS_ALIVE) {
     ogl::pushmatrix();
     ogl::ortho(0, VIRTW/2, VIRTH/2, 0, -1, 1);
-    drawtextf("%d",  90, 827, 2, game::player1->health);
-    if (game::player1->armour) drawtextf("%d", 390, 827, 2, game::player1->armour);
-    drawtextf("%d", 690, 827, 2, game::player1->ammo[game::player1->gunselect]);
+    drawtextf("%d",  90, 827, 2, game::viewer()->health);
+    if (game::viewer()->armour) drawtextf("%d", 390, 827, 2, game::viewer()->armour);
+    drawtextf("%d", 690, 827, 2, game::viewer()->ammo[game::viewer()->gunselect]);
     ogl::popmatrix();
     ogl::pushmatrix();
     ogl::ortho(0.f, float(VIRTW), float(VIRTH), 0.f, -1.f, 1.f);
     ogl::disablev(GL_BLEND);
     drawicon(128, 128, 20, 1650);
-    if (game::player1->armour) drawicon((float)(game::player1->armourtype*64), 0, 620, 1650);
-    int g = game::player1->gunselect;
+    if (game::viewer()->armour) drawicon((float)(game::viewer()->armourtype*64), 0, 620, 1650);
+    int g = game::viewer()->gunselect;
     int r = 64;
     if (g>2) { g -= 3; r = 128; }
     drawicon((float)(g*64), (float)r, 1220, 1650);
@@ -23,6 +23,8 @@ struct md2_frame {
   md2_vertex vertices[1];
 };
 
+struct modelrequest;
+
 struct md2 {
   enum {channenum = 5}; // s,t,x,y,z
   int numGlCommands;
@@ -41,24 +43,45 @@ struct md2 {
   char *loadname;
   int mdlnum;
   bool loaded;
-  bool load(char* filename);
+  ref<modelrequest> loading; // null once loaded
+  bool load(const char* filename);
+  void upload(void);
   void render(vec3f &light, int numFrame, int range, const vec3f &o,
               float yaw, float pitch, float scale, float speed, int snap, int basetime);
   void scale(int frame, float scale, int sn);
 
-  md2(void) { memset(this,0,sizeof(md2)); }
+  md2(void) { memset((void*)this,0,sizeof(md2)); }
+  ~md2(void);
+};
 
-  ~md2(void) {
-    if (vbo) ogl::deletebuffers(1, &vbo);
-    SAFE_DELETEA(glcommands);
-    SAFE_DELETEA(frames);
-    SAFE_DELETEA(builtframes);
-    FREE(loadname);
+// the file is parsed by a task thread. the main thread creates the vertex
+// buffer and asks for the skin
+struct modelrequest : asset::request {
+  modelrequest(md2 *m) : asset::request("model"), m(m), ok(false) {
+    sprintf_s(name)("packages/models/%s/tris.md2", m->loadname);
+    path(name);
   }
+  virtual void load(void) { ok = m->load(name); }
+  virtual void finish(void);
+  md2 *m; // null if the model was freed while loading
+  bool ok;
+  string name;
 };
 
+md2::~md2(void) {
+  if (loading) {
+    loading->waitload();
+    loading->m = NULL;
+  }
+  if (vbo) ogl::deletebuffers(1, &vbo);
+  SAFE_DELETEA(glcommands);
+  SAFE_DELETEA(frames);
+  SAFE_DELETEA(builtframes);
+  FREE(loadname);
+}
+
 
-bool md2::load(char* filename) {
+bool md2::load(const char* filename) {
   FILE* file;
   md2_header header;
 
@@ -89,7 +112,10 @@ bool md2::load(char* filename) {
   numVerts     = header.numVertices;
 
   fclose(file);
+  return true;
+}
 
+void md2::upload(void) {
   builtframes = NEWAE(bool,numFrames);
   loopj(numFrames) builtframes[j] = false;
 
@@ -103,7 +129,6 @@ bool md2::load(char* filename) {
   ogl::bindbuffer(ogl::ARRAY_BUFFER, vbo);
   OGL(BufferData, GL_ARRAY_BUFFER, numFrames*framesz, NULL, GL_STATIC_DRAW);
   ogl::bindbuffer(ogl::ARRAY_BUFFER, 0);
-  return true;
 }
 
 static float snap(int sn, float f) {
@@ -172,15 +197,23 @@ static hashtable<md2*> *mdllookup = NULL;
 static vector<md2*> mapmodels;
 static const int FIRSTMDL = 20;
 
-static void delayedload(md2 *m) {
-  if (!m->loaded) {
-    sprintf_sd(name1)("packages/models/%s/tris.md2", m->loadname);
-    if (!m->load(path(name1))) fatal("loadmodel: ", name1);
-    sprintf_sd(name2)("packages/models/%s/skin.jpg", m->loadname);
-    int xs, ys;
-    ogl::installtex(FIRSTMDL+m->mdlnum, path(name2), xs, ys);
-    m->loaded = true;
+void modelrequest::finish(void) {
+  if (m == NULL) return;
+  if (!ok) fatal("loadmodel: ", name);
+  m->upload();
+  sprintf_sd(skin)("packages/models/%s/skin.jpg", m->loadname);
+  ogl::requesttex(FIRSTMDL+m->mdlnum, path(skin));
+  m->loaded = true;
+  m->loading = nil;
+}
+
+// true when the model can be drawn. it is loaded on first sight
+static bool delayedload(md2 *m) {
+  if (!m->loaded && !m->loading) {
+    m->loading = NEW(modelrequest, m);
+    asset::submit(m->loading);
   }
+  return m->loaded;
 }
 
 static int modelnum = 0;
@@ -222,12 +255,24 @@ COMMAND(mapmodelreset, ARG_NONE);
 void rendermodel(const char *mdl, int frame, int range, int tex,
                  float rad, const vec3f &o,
                  float yaw, float pitch, bool teammate,
-                 float scale, float speed, int snap, int basetime) {
+                 float scale, float speed, int snap, int basetime, float height) {
   md2 *m = loadmodel(mdl);
-  if (world::isoccluded(game::player1->o.x, game::player1->o.y, o.x-rad, o.z-rad, rad*2))
+  const float r = max(rad, 1.f)*max(scale, 1.f);
+  const float top = max(height*max(scale, 1.f), 2.f*r); // models are taller than wide
+  const vec3f pmin(o.x-r, o.y-(height > 0.f ? r : 2.f*r), o.z-r);
+  if (world::isoccluded(aabb(pmin, vec3f(o.x+r, o.y+top, o.z+r)))) return;
+
+  if (!delayedload(m)) {
+    // placeholder until the model is loaded
+    ogl::bindgametexture(GL_TEXTURE_2D, FIRSTMDL+m->mdlnum);
+    ogl::pushmatrix();
+    ogl::translate(o);
+    ogl::scale(vec3f(r));
+    OGL(VertexAttrib3f, ogl::COL, 1.0f, 1.0f, 1.0f);
+    ogl::drawsphere();
+    ogl::popmatrix();
     return;
-
-  delayedload(m);
+  }
 
   int xs, ys;
   ogl::bindgametexture(GL_TEXTURE_2D, tex ? ogl::lookuptex(tex, xs, ys) : FIRSTMDL+m->mdlnum);
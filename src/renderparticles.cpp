@@ -9,6 +9,11 @@ struct particle { vec3f o, d; int fade, type; int millis; particle *next; };
 static particle particles[MAXPARTICLES], *parlist = NULL, *parempty = NULL;
 static bool parinit = false;
 
+// particles as they were when the snapshot was taken. the simulation may
+// update the list while they are drawn
+struct drawnparticle { vec3f o; int type; };
+static vector<drawnparticle> drawnparticles;
+
 VARP(maxparticles, 100, 2000, MAXPARTICLES-500);
 VAR(demotracking, 0, 0, 1);
 VARP(particlesize, 20, 100, 500);
@@ -89,26 +94,59 @@ void cleanparticles(void) {
   }
   SAFE_DELETEA(glparts);
 }
-void render_particles(int time) {
+
+void updateparticles(int time) {
   if (demo::playing() && demotracking) {
     const vec3f nom(0, 0, 0);
     newparticle(game::player1->o, nom, 100000000, 8);
   }
+  // show sparkly thingies for map entities in edit mode
+  if (edit::mode()) loopv(game::ents) {
+    const game::entity &e = game::ents[i];
+    if (e.type==game::NOTUSED) continue;
+    particle_splash(2, 2, 40, vec3f(float(e.x), float(e.y), float(e.z)));
+  }
+  int num = 0;
+  for (particle *p, **pp = &parlist; (p = *pp);) {
+    const parttype *pt = &parttypes[p->type];
+    if (num++>maxparticles || (p->fade -= time)<0) {
+      *pp = p->next;
+      p->next = parempty;
+      parempty = p;
+    } else {
+      if (pt->gr) p->o.z -= ((game::lastmillis()-p->millis)/3.0f)*game::curtime()/(pt->gr*10000);
+      vec3f a = p->d;
+      a *= float(time);
+      a /= 20000.f;
+      p->o += a;
+      pp = &p->next;
+    }
+  }
+}
+
+void snapshotparticles(void) {
+  drawnparticles.clear();
+  for (particle *p = parlist; p; p = p->next) {
+    drawnparticle &d = drawnparticles.add();
+    d.o = p->o;
+    d.type = p->type;
+  }
+}
+
+void render_particles(void) {
   if (particleibo == 0u) initparticles();
 
   // bucket sort the particles
   u32 partbucket[parttypen], partbucketsize[parttypen];
   loopi(parttypen) partbucketsize[i] = 0;
-  for (particle *p, **pp = &parlist; (p = *pp);) {
-    pp = &p->next;
-    partbucketsize[p->type]++;
-  }
+  loopv(drawnparticles) partbucketsize[drawnparticles[i].type]++;
   partbucket[0] = 0;
   loopi(parttypen-1) partbucket[i+1] = partbucket[i]+partbucketsize[i];
 
   // copy the particles to the vertex buffer
-  int numrender = 0;
-  for (particle *p, **pp = &parlist; (p = *pp);) {
+  const int numrender = drawnparticles.size();
+  loopv(drawnparticles) {
+    const drawnparticle *p = &drawnparticles[i];
     const u32 index = 4*partbucket[p->type]++;
     const parttype *pt = &parttypes[p->type];
     const float sz = pt->sz*particlesize/100.0f;
@@ -117,18 +155,6 @@ void render_particles(int time) {
     glparts[index+1] = glparticle(pt->rgb, 1.f, 1.f, poxzy+(right+up)*sz);
     glparts[index+2] = glparticle(pt->rgb, 0.f, 0.f, poxzy-(right+up)*sz);
     glparts[index+3] = glparticle(pt->rgb, 1.f, 0.f, poxzy-(up-right)*sz);
-	if (numrender++>maxparticles || (p->fade -= time)<0) {
-      *pp = p->next;
-      p->next = parempty;
-      parempty = p;
-    } else {
-      if (pt->gr) p->o.z -= ((game::lastmillis()-p->millis)/3.0f)*game::curtime()/(pt->gr*10000);
-      vec3f a = p->d;
-      a *= float(time);
-      a /= 20000.f;
-      p->o += a;
-      pp = &p->next;
-    }
   }
 
   // render all of them now
@@ -54,10 +54,32 @@ static void music(const char *name) {
   }
 }
 
+// samples are decoded by a task thread as soon as they are registered. a
+// sound played before its sample is ready is skipped
+struct samplerequest : asset::request {
+  samplerequest(int n) : asset::request("sample"), n(n), chunk(NULL) {
+    sprintf_s(name)("packages/sounds/%s.wav", snames[n]);
+    path(name);
+  }
+  virtual ~samplerequest(void) { if (chunk) Mix_FreeChunk(chunk); }
+  virtual void load(void) { chunk = Mix_LoadWAV(name); }
+  virtual void finish(void) {
+    if (chunk == NULL)
+      console::out("failed to load sample: %s", name);
+    else if (n < samples.size())
+      samples[n] = chunk;
+    chunk = NULL;
+  }
+  int n;
+  Mix_Chunk *chunk;
+  string name;
+};
+
 static int registersound(const char *name) {
   loopv(snames) if (strcmp(snames[i], name)==0) return i;
   snames.add(NEWSTRING(name));
   samples.add(NULL);
+  if (!nosound) asset::submit(NEW(samplerequest, samples.size()-1));
   return samples.size()-1;
 }
 
@@ -125,14 +147,7 @@ void play(int n, const vec3f *loc) {
     return;
   }
 
-  if (!samples[n]) {
-    sprintf_sd(buf)("packages/sounds/%s.wav", snames[n]);
-    samples[n] = Mix_LoadWAV(path(buf));
-    if (!samples[n]) {
-      console::out("failed to load sample: %s", buf);
-      return;
-    }
-  }
+  if (!samples[n]) return; // still loading
 
   const int chan = Mix_PlayChannel(-1, samples[n], 0);
   if (chan<0) return;
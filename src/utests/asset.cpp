@@ -0,0 +1,111 @@
+#include "../asset.hpp"
+#include "../base/command.hpp"
+#include <SDL/SDL.h>
+#include <SDL/SDL_thread.h>
+#include <cstdio>
+
+namespace cube {
+namespace console {
+void out(const char *s, ...) {}
+void writebinds(FILE *f) {}
+} // namespace console
+namespace client {
+void writeclientinfo(filehandle f) {}
+} // namespace client
+
+#define CHECK(COND) do {\
+  if (!(COND)) {\
+    fprintf(stderr, "error with %s in function %s", #COND, __FUNCTION__);\
+    exit(EXIT_FAILURE);\
+  }\
+} while (0)
+
+static u32 mainthread = 0;
+static atomic loadnum(0), finishnum(0);
+
+// read back a file written by the test
+struct filerequest : asset::request {
+  filerequest(const char *name, s32 expected) :
+    asset::request("file"), name(name), expected(expected), value(-1) {}
+  virtual void load(void) {
+    FILE *f = fopen(name, "r");
+    if (f) {
+      if (fscanf(f, "%d", &value) != 1) value = -1;
+      fclose(f);
+    }
+    loadnum++;
+  }
+  virtual void finish(void) {
+    CHECK(SDL_ThreadID() == mainthread);
+    CHECK(value == expected);
+    finishnum++;
+  }
+  const char *name;
+  s32 expected, value;
+};
+
+void testload(void) {
+  const char *name = "assettest.txt";
+  FILE *f = fopen(name, "w");
+  CHECK(f != NULL);
+  fprintf(f, "42\n");
+  fclose(f);
+
+  // the uploads are spread over the frames
+  const s32 n = 16, budget = 3;
+  cmd::setvar("assetuploads", budget);
+  loopi(n) asset::submit(NEW(filerequest, name, 42));
+  CHECK(asset::pending() == u32(n));
+  while (asset::pending()) {
+    const s32 before = finishnum;
+    asset::update();
+    CHECK(finishnum-before <= budget);
+    SDL_Delay(1);
+  }
+  CHECK(loadnum == n && finishnum == n);
+  remove(name);
+}
+
+// dropped requests are never finished
+void testclean(void) {
+  loadnum = 0;
+  finishnum = 0;
+  loopi(8) asset::submit(NEW(filerequest, "doesnotexist.txt", -1));
+  asset::clean();
+  CHECK(loadnum == 8 && finishnum == 0);
+  CHECK(asset::pending() == 0);
+  asset::update();
+  CHECK(finishnum == 0);
+}
+
+// with no task thread, requests are loaded when submitted
+void testnothread(void) {
+  const u32 threadnum = 0;
+  tasking::init(&threadnum,1);
+  loadnum = 0;
+  finishnum = 0;
+  loopi(4) asset::submit(NEW(filerequest, "doesnotexist.txt", -1));
+  CHECK(loadnum == 4);
+  asset::update(); // budget of 3 left by testload
+  asset::update();
+  CHECK(finishnum == 4 && asset::pending() == 0);
+  asset::clean();
+  tasking::clean();
+}
+
+int main(void) {
+  const u32 threadnum = 2;
+  mainthread = SDL_ThreadID();
+  tasking::init(&threadnum,1);
+  testload();
+  testclean();
+  tasking::clean();
+  testnothread();
+  return 0;
+}
+#undef CHECK
+
+} // namespace cube
+
+int main(void) { return cube::main(); }
+
@@ -0,0 +1,199 @@
+#include "../brickmesh.hpp"
+#include "../base/task.hpp"
+#include "utests.hpp"
+
+namespace cube {
+
+using namespace world;
+static const brickcube full(vec3<s8>(zero), FULL);
+
+// 16x16 floor: a top and a bottom face per cube plus the 4 sides
+static void makefloor(bricksnapshot &s, vec3i org) {
+  s.org = org;
+  loopxyz(org-vec3i(1), org+vec3i(lvl1+1), s.set(xyz, emptycube));
+  loopi(lvl1) loopj(lvl1) s.set(org+vec3i(i,j,0), full);
+}
+
+static void checkbuild(const brickbuild &out, int lmres, u32 quadnum) {
+  CHECK(u32(out.quads.size()) == quadnum);
+  CHECK(out.lmdim.x == maxlmw);
+  loopv(out.quads) {
+    const lightmapquad &q = out.quads[i];
+    const vec2i texn = lmres*vec2i(q.size.y, q.size.x);
+    CHECK(all(q.uv >= vec2i(zero)) && all(q.uv+texn < out.lmdim));
+    if (i > 0) CHECK(q.uv.y >= out.quads[i-1].uv.y);
+  }
+  CHECK(out.mesh != NULL);
+  CHECK(out.mesh->indexnum == 6*quadnum);
+  CHECK(out.mesh->vertnum <= 4*quadnum);
+  u32 drawn = 0;
+  loopi(s32(out.mesh->drawnum)) drawn += out.mesh->draws()[i].x;
+  CHECK(drawn == out.mesh->indexnum);
+  loopi(s32(out.mesh->indexnum)) CHECK(out.mesh->indices()[i] < out.mesh->vertnum);
+}
+
+void testfloor(void) {
+  const int lmres = 4;
+  bricksnapshot *s = NEWE(bricksnapshot);
+  brickbuild out;
+  makefloor(*s, vec3i(zero));
+  buildbrick(*s, lmres, false, out);
+  checkbuild(out, lmres, 2*lvl1*lvl1+4*lvl1);
+  CHECK(out.occluders.size() == 0); // single faces are never occluders
+  deletemeshblob(out.mesh);
+  SAFE_DELETE(s);
+}
+
+void testfacemasks(void) {
+  bricksnapshot *s = NEWE(bricksnapshot);
+  makefloor(*s, vec3i(zero));
+  s->set(vec3i(3,3,1), full);
+  buildfacemasks(*s);
+  CHECK(s->visiblefaces(vec3i(0,0,0)) == 0x35); // -x, -y, -z and +z
+  CHECK(s->visiblefaces(vec3i(5,5,0)) == 0x30);
+  CHECK(s->visiblefaces(vec3i(3,3,0)) == 0x10); // covered by (3,3,1)
+  CHECK(s->visiblefaces(vec3i(3,3,1)) == 0x2f);
+  CHECK(s->visiblefaces(vec3i(3,3,2)) == 0);
+  SAFE_DELETE(s);
+}
+
+// the floor is one quad per side when all faces are flat with one texture
+void testgreedy(void) {
+  const int lmres = 4;
+  bricksnapshot *s = NEWE(bricksnapshot);
+  brickbuild flat, split, deformed;
+  makefloor(*s, vec3i(zero));
+  buildbrick(*s, lmres, true, flat);
+  checkbuild(flat, lmres, 6);
+  CHECK(flat.mesh->vertnum == 24);
+  CHECK(flat.occluders.size() == 6);
+  const aabb top(vec3f(0.f,0.f,1.f), vec3f(float(lvl1),float(lvl1),1.f));
+  bool hastop = false;
+  loopv(flat.occluders)
+    hastop |= all(flat.occluders[i].pmin==top.pmin) && all(flat.occluders[i].pmax==top.pmax);
+  CHECK(hastop);
+  loopv(flat.quads) {
+    const lightmapquad &q = flat.quads[i];
+    CHECK(q.size.x*q.size.y == (q.face >= 4 ? lvl1*lvl1 : lvl1));
+  }
+
+  // another texture on half of the top faces
+  brickcube other = full;
+  other.tex[5] = 2;
+  loopi(lvl1/2) loopj(lvl1) s->set(vec3i(i,j,0), other);
+  buildbrick(*s, lmres, true, split);
+  checkbuild(split, lmres, 7);
+
+  // a displaced vertex in the middle of the top removes 4 faces from the
+  // rectangles
+  s->set(vec3i(4,4,1), brickcube(vec3<s8>(0,0,-64)));
+  buildbrick(*s, lmres, true, deformed);
+  CHECK(deformed.quads.size() > split.quads.size()+4);
+  u32 single = 0;
+  loopv(deformed.quads) if (deformed.quads[i].size.x*deformed.quads[i].size.y == 1) ++single;
+  CHECK(single >= 4);
+  deletemeshblob(flat.mesh);
+  deletemeshblob(split.mesh);
+  deletemeshblob(deformed.mesh);
+  SAFE_DELETE(s);
+}
+
+// worst case for the vertex number: every face of every other cube is visible
+void testcheckerboard(void) {
+  bricksnapshot *s = NEWE(bricksnapshot);
+  brickbuild out;
+  makefloor(*s, vec3i(zero));
+  loopxyz(0, vec3i(lvl1), s->set(xyz, ((X+Y+Z)&1) ? emptycube : full));
+  buildbrick(*s, 2, false, out);
+  checkbuild(out, 2, 6*lvl1*lvl1*lvl1/2);
+  CHECK(out.mesh->vertnum <= u32(maxgridvertices));
+  deletemeshblob(out.mesh);
+  SAFE_DELETE(s);
+}
+
+void testempty(void) {
+  bricksnapshot *s = NEWE(bricksnapshot);
+  brickbuild out;
+  makefloor(*s, vec3i(zero));
+  loopi(lvl1) loopj(lvl1) s->set(vec3i(i,j,0), emptycube);
+  buildbrick(*s, 4, true, out);
+  CHECK(out.quads.size() == 0 && out.mesh == NULL);
+  SAFE_DELETE(s);
+}
+
+// one layer of cells: welded vertices on the top, the bottom and the sides
+void testlod(void) {
+  lodsnapshot *s = NEWE(lodsnapshot);
+  s->org = vec3i(zero);
+  MEMZERO(s->cells);
+  MEMZERO(s->tex);
+  loopi(lodcells) loopj(lodcells) {
+    s->cells[i+1][j+1][1] = true;
+    s->tex[i][j][0][5] = i < lodcells/2 ? 1 : 2;
+  }
+  meshblob *m = buildlod(*s);
+  const u32 facenum = 2*lodcells*lodcells + 4*lodcells;
+  CHECK(m != NULL);
+  CHECK(m->indexnum == 6*facenum);
+  CHECK(m->vertnum == 2*(lodcells+1)*(lodcells+1) + 8*(lodcells+1));
+  CHECK(m->drawnum == 3);
+  u32 drawn = 0;
+  loopi(s32(m->drawnum)) drawn += m->draws()[i].x;
+  CHECK(drawn == m->indexnum);
+  loopi(s32(m->indexnum)) CHECK(m->indices()[i] < m->vertnum);
+  deletemeshblob(m);
+  MEMZERO(s->cells);
+  CHECK(buildlod(*s) == NULL);
+  SAFE_DELETE(s);
+}
+
+// bricks built in the task threads must match the ones built serially
+struct buildtask : public task {
+  buildtask(bricksnapshot *s, brickbuild *out, u32 n) :
+    task("buildtask", n, 1), s(s), out(out) {}
+  void run(u32 i) { buildbrick(s[i], 4, true, out[i]); }
+  bricksnapshot *s;
+  brickbuild *out;
+};
+
+void testparallel(void) {
+  const s32 n = 8;
+  bricksnapshot *s = NEWAE(bricksnapshot, n);
+  brickbuild out[n], ref[n];
+  loopi(n) {
+    makefloor(s[i], vec3i(i*lvl1,0,0));
+    loopj(i) s[i].set(s[i].org+vec3i(j,j,1), full); // some stairs on top
+    buildbrick(s[i], 4, true, ref[i]);
+  }
+  cube::ref<buildtask> job = NEW(buildtask, s, out, n);
+  job->scheduled();
+  job->wait();
+  loopi(n) {
+    CHECK(out[i].quads.size() == ref[i].quads.size());
+    CHECK(all(out[i].lmdim == ref[i].lmdim));
+    CHECK(out[i].mesh->vertnum == ref[i].mesh->vertnum);
+    CHECK(out[i].mesh->indexnum == ref[i].mesh->indexnum);
+    CHECK(memcmp(out[i].mesh->indices(), ref[i].mesh->indices(), ref[i].mesh->indexnum*sizeof(u16)) == 0);
+    deletemeshblob(out[i].mesh);
+    deletemeshblob(ref[i].mesh);
+  }
+  SAFE_DELETEA(s);
+}
+
+int main(void) {
+  const u32 threadnum = 3;
+  tasking::init(&threadnum,1);
+  testfloor();
+  testfacemasks();
+  testgreedy();
+  testcheckerboard();
+  testempty();
+  testlod();
+  testparallel();
+  tasking::clean();
+  return 0;
+}
+
+} // namespace cube
+
+int main(void) { return cube::main(); }
@@ -0,0 +1,84 @@
+#include "../cube.hpp"
+#include "../oglrecord.hpp"
+#include "utests.hpp"
+
+/*-------------------------------------------------------------------------
+ - regression test of the renderer: a small fixed scene is drawn with the
+ - opengl recorder (__GLRECORD__ build) and the recorded work must stay below
+ - the numbers seen when the test was written
+ -------------------------------------------------------------------------*/
+namespace cube {
+void fatal(const char *s, const char *o) {
+  fprintf(stderr, "%s%s\n", s, o);
+  exit(EXIT_FAILURE);
+}
+void keyrepeat(bool on) {}
+
+static const int scrw = 640, scrh = 480;
+
+// hollow box 32 cubes wide centered on the world. the viewer sits in its middle
+// so the scene does not depend on the axis order of the grid
+static const int roomhalf = 16, wall = 4;
+static void buildroom(void) {
+  const world::brickcube full(vec3<s8>(zero), world::FULL);
+  const vec3i center(world::size/2);
+  loopxyz(center-vec3i(roomhalf), center+vec3i(roomhalf), {
+    const vec3i d = abs(xyz-center);
+    if (any(d >= vec3i(roomhalf-wall))) world::setcube(xyz, full);
+  });
+  game::player1->o = vec3f(float(world::size/2));
+  game::player1->yaw = 30.f;
+  game::player1->pitch = -10.f;
+}
+
+static const ogl::record::stats &drawframe(void) {
+  game::takesnapshot();
+  ogl::buildworld();
+  ogl::drawframe(scrw, scrh, 60.f);
+  return ogl::record::frame();
+}
+
+// the meshes and light maps are built and uploaded over a few frames with a
+// time budget. we draw until two frames upload the same. then, a frame only
+// binds, draws and streams the hud
+void testframe(void) {
+  buildroom();
+  const u64 before = ogl::record::total().uploaded;
+  u64 last = ~u64(0);
+  loopi(256) {
+    const u64 up = drawframe().uploaded;
+    if (up == last) break;
+    last = up;
+  }
+  const u64 uploaded = ogl::record::total().uploaded-before;
+  const ogl::record::stats &s = drawframe();
+  printf("steady frame: %u draws, %u elements, %u states, %u uniforms, %u attribs\n",
+    s.draws, s.elements, s.states, s.uniforms, s.attribs);
+  printf("steady frame: %u program, %u texture and %u buffer binds (%u redundant), "
+    "%u KB uploaded (%u KB while building)\n", s.programs, s.textures, s.buffers,
+    s.redundant, u32(s.uploaded/KB), u32(uploaded/KB));
+  CHECK(s.draws > 0);
+  CHECK(s.draws <= 56);
+  CHECK(s.states <= 64);
+  CHECK(s.programs+s.textures+s.buffers <= 40);
+  CHECK(s.redundant <= 4);
+  CHECK(s.uploaded <= 32*KB);
+  CHECK(uploaded <= 8*MB);
+}
+
+int main(void) {
+  const u32 threadnum = 0;
+  tasking::init(&threadnum, 1);
+  ogl::init(scrw, scrh);
+  testframe();
+  asset::clean();
+  rr::clean();
+  world::clean();
+  ogl::clean();
+  tasking::clean();
+  return 0;
+}
+
+} // namespace cube
+
+int main(void) { return cube::main(); }
@@ -0,0 +1,82 @@
+#include "../world.hpp"
+#include "utests.hpp"
+
+namespace cube {
+namespace world {
+lvl3grid root;
+} // namespace world
+
+static const mat4x4f viewproj(vec3f eye, vec3f center, float fovy, float farplane) {
+  return perspective(fovy, 1.f, 0.1f, farplane) * lookat(eye, center, vec3f(0.f,1.f,0.f));
+}
+
+void testclassify(void) {
+  const frustum fr(viewproj(vec3f(zero), vec3f(0.f,0.f,-1.f), 90.f, 100.f));
+  CHECK(fr.classify(aabb(vec3f(-1.f,-1.f,-10.f), vec3f(1.f,1.f,-8.f))) == frustum::INSIDE);
+  CHECK(fr.classify(aabb(vec3f(-1.f,-1.f,8.f), vec3f(1.f,1.f,10.f))) == frustum::OUTSIDE);
+  CHECK(fr.classify(aabb(vec3f(-1.f,-1.f,-200.f), vec3f(1.f,1.f,-150.f))) == frustum::OUTSIDE);
+  CHECK(fr.classify(aabb(vec3f(20.f,-1.f,-10.f), vec3f(30.f,1.f,-8.f))) == frustum::OUTSIDE);
+  CHECK(fr.classify(aabb(vec3f(-1.f,-1.f,-10.f), vec3f(15.f,1.f,-8.f))) == frustum::INTERSECT);
+  CHECK(fr.classify(aabb(vec3f(-1000.f), vec3f(1000.f))) == frustum::INTERSECT);
+}
+
+// the hierarchical walk must find exactly the bricks found by brute force
+static void checkvisible(const frustum &fr) {
+  using namespace world;
+  const frustumculler cull(fr);
+  u32 expected = 0, found = 0;
+  u64 expectedsum = 0, foundsum = 0;
+  forallbricks([&](lvl1grid &b, vec3i org) {
+    if (cull(org, brickisize) == frustum::OUTSIDE) return;
+    ++expected;
+    expectedsum += u64(org.x) + (u64(org.y)<<16) + (u64(org.z)<<32);
+  });
+  const u32 tests = forallvisiblebricks(fr, [&](lvl1grid &b, vec3i org) {
+    ++found;
+    foundsum += u64(org.x) + (u64(org.y)<<16) + (u64(org.z)<<32);
+  });
+  CHECK(found == expected && foundsum == expectedsum);
+  CHECK(tests <= cull.tests);
+}
+
+void testhierarchy(void) {
+  using namespace world;
+  const brickcube full(vec3<s8>(zero), FULL);
+  u32 bricknum = 0;
+  for (int x = 0; x < size; x += 3*lvl1)
+  for (int y = 0; y < size; y += 2*lvl1)
+  for (int z = 0; z < size; z += 3*lvl1) {
+    root.set(vec3i(x,y,z), full);
+    ++bricknum;
+  }
+  const vec3f center = vec3f(float(size/2)).xzy();
+
+  // looking along the world x axis with a narrow field of view
+  const frustum narrow(viewproj(center, center+vec3f(1.f,0.f,0.f), 30.f, 1000.f));
+  checkvisible(narrow);
+
+  // everything is visible from far away
+  const vec3f far = center+vec3f(0.f,0.f,4.f*float(size));
+  const frustum all(viewproj(far, center, 90.f, 10000.f));
+  u32 n = 0;
+  const u32 tests = forallvisiblebricks(all, [&](lvl1grid &b, vec3i org) {++n;});
+  CHECK(n == bricknum);
+  CHECK(tests <= u32(lvl3*lvl3*lvl3)); // only the root children are tested
+  checkvisible(all);
+
+  // looking away from the world
+  const frustum away(viewproj(far, far+vec3f(0.f,0.f,1.f), 90.f, 10000.f));
+  n = 0;
+  forallvisiblebricks(away, [&](lvl1grid &b, vec3i org) {++n;});
+  CHECK(n == 0);
+}
+
+int main(void) {
+  testclassify();
+  testhierarchy();
+  return 0;
+}
+
+} // namespace cube
+
+int main(void) { return cube::main(); }
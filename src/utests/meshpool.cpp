@@ -0,0 +1,91 @@
+#include "../meshpool.hpp"
+#include "utests.hpp"
+
+namespace cube {
+
+using namespace world;
+
+// quads of vertnum/4 faces. vertex x stores the vertex index in the mesh
+static meshblob *newquads(u32 vertnum) {
+  meshblob *m = newmeshblob(vertnum, vertnum/4*6, 1);
+  loopi(s32(vertnum)) {
+    m->vertices()[i] = gridvertex();
+    m->vertices()[i].pos.x = s16(i);
+  }
+  loopi(s32(vertnum/4)) {
+    const u16 q[] = {0,1,2,0,2,3};
+    loopj(6) m->indices()[6*i+j] = u16(4*i+q[j]);
+  }
+  m->draws()[0] = vec2i(vertnum/4*6, 0);
+  return m;
+}
+
+// every index must point to the vertex it had in its mesh
+static bool valid(u32 slot) {
+  const meshslot &s = getmeshslot(slot);
+  const meshpool &p = getmeshpool(s.pool);
+  loopi(s32(s.indexnum)) {
+    const u32 idx = p.indices[s.firstindex+i];
+    if (idx < s.firstvert || idx >= s.firstvert+s.vertnum) return false;
+    const u32 q[] = {0,1,2,0,2,3};
+    if (u32(p.vertices[idx].pos.x) != 4*(i/6)+q[i%6]) return false;
+  }
+  return true;
+}
+
+void testcompaction(void) {
+  meshblob *m0 = newquads(400), *m1 = newquads(800);
+  const u32 s0 = allocmesh(*m0), s1 = allocmesh(*m1);
+  CHECK(s0 != 0 && s1 != 0 && s0 != s1);
+  CHECK(meshpoolnum() == 1);
+  CHECK(getmeshslot(s1).firstvert == 400 && getmeshslot(s1).firstindex == 600);
+  CHECK(valid(s0) && valid(s1));
+  CHECK(getmeshpool(0).dirtyvert.y == 1200);
+  cleanmeshpool(getmeshpool(0));
+
+  // the hole is not big enough yet
+  freemesh(s0);
+  CHECK(compactmeshpools(0.5f) == 0);
+  CHECK(compactmeshpools(0.25f) == 1);
+  const meshpool &p = getmeshpool(0);
+  CHECK(getmeshslot(s1).firstvert == 0 && getmeshslot(s1).firstindex == 0);
+  CHECK(p.vertused == 800 && p.indexused == 1200);
+  CHECK(p.dirtyvert.x == 0 && p.dirtyvert.y == 800);
+  CHECK(p.dirtyindex.x == 0 && p.dirtyindex.y == 1200);
+  CHECK(valid(s1));
+  freemesh(s1);
+  CHECK(p.vertused == 0 && p.vertlive == 0);
+  deletemeshblob(m0);
+  deletemeshblob(m1);
+  destroymeshpools();
+}
+
+// a full pool is compacted before a new one is created
+void testfull(void) {
+  const u32 n = 16384;
+  meshblob *m = newquads(n);
+  u32 slots[5];
+  loopi(4) slots[i] = allocmesh(*m);
+  CHECK(meshpoolnum() == 1);
+  freemesh(slots[1]);
+  slots[1] = allocmesh(*m);
+  CHECK(meshpoolnum() == 1);
+  CHECK(getmeshslot(slots[1]).firstvert == 3*n);
+  slots[4] = allocmesh(*m);
+  CHECK(meshpoolnum() == 2 && getmeshslot(slots[4]).pool == 1);
+  loopi(5) CHECK(valid(slots[i]));
+  loopi(5) freemesh(slots[i]);
+  deletemeshblob(m);
+  destroymeshpools();
+}
+
+int main(void) {
+  testcompaction();
+  testfull();
+  return 0;
+}
+
+} // namespace cube
+
+int main(void) { return cube::main(); }
+
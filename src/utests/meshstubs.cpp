@@ -0,0 +1,10 @@
+#include "../world.hpp"
+
+// for the tests that do not link the mesh pools
+namespace cube {
+namespace world {
+void deletemeshblob(meshblob *blob) {}
+void freemesh(u32 slot) {}
+} // namespace world
+} // namespace cube
+
@@ -0,0 +1,59 @@
+#include "../world.hpp"
+#include "utests.hpp"
+
+namespace cube {
+
+using namespace world;
+
+// looking along -z in opengl space (that is -y in the world)
+static const mat4x4f viewproj(void) {
+  const vec3f eye(zero), center(0.f,0.f,-1.f);
+  return perspective(90.f, 1.f, 0.1f, 1000.f) * lookat(eye, center, vec3f(0.f,1.f,0.f));
+}
+
+// occluders are in world space while the boxes are in opengl space
+void testwall(void) {
+  lvl1grid *b = NEWE(lvl1grid);
+  b->occluders.add(aabb(vec3f(-5.f,-10.f,-5.f), vec3f(5.f,-10.f,5.f)));
+  beginocclusion(viewproj(), 4.f);
+  addoccluders(*b);
+  CHECK(isoccluded(aabb(vec3f(-1.f,-1.f,-30.f), vec3f(1.f,1.f,-28.f))));
+  CHECK(isoccluded(aabb(vec3f(10.f,-1.f,-30.f), vec3f(12.f,1.f,-28.f))));
+  CHECK(!isoccluded(aabb(vec3f(-1.f,-1.f,-6.f), vec3f(1.f,1.f,-4.f)))); // in front
+  CHECK(!isoccluded(aabb(vec3f(20.f,-1.f,-30.f), vec3f(22.f,1.f,-28.f)))); // beside
+  CHECK(!isoccluded(aabb(vec3f(-1.f,-1.f,-30.f), vec3f(1.f,1.f,1.f)))); // crosses the eye
+  u32 tested, culled;
+  occlusionstats(tested, culled);
+  CHECK(tested == 5 && culled == 2);
+  endocclusion();
+  CHECK(!isoccluded(aabb(vec3f(-1.f,-1.f,-30.f), vec3f(1.f,1.f,-28.f))));
+
+  // too small to be an occluder
+  beginocclusion(viewproj(), 1000.f);
+  addoccluders(*b);
+  CHECK(!isoccluded(aabb(vec3f(-1.f,-1.f,-30.f), vec3f(1.f,1.f,-28.f))));
+  endocclusion();
+  SAFE_DELETE(b);
+}
+
+// the floor goes behind the eye and must be clipped by the near plane
+void testfloor(void) {
+  lvl1grid *b = NEWE(lvl1grid);
+  b->occluders.add(aabb(vec3f(-50.f,-50.f,-2.f), vec3f(50.f,50.f,-2.f)));
+  beginocclusion(viewproj(), 4.f);
+  addoccluders(*b);
+  CHECK(isoccluded(aabb(vec3f(-1.f,-6.f,-20.f), vec3f(1.f,-4.f,-18.f))));
+  CHECK(!isoccluded(aabb(vec3f(-1.f,-1.f,-20.f), vec3f(1.f,1.f,-18.f))));
+  endocclusion();
+  SAFE_DELETE(b);
+}
+
+int main(void) {
+  testwall();
+  testfloor();
+  return 0;
+}
+
+} // namespace cube
+
+int main(void) { return cube::main(); }
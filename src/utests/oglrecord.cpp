@@ -0,0 +1,97 @@
+#include "../ogl.hpp"
+#include "../oglrecord.hpp"
+#include <cstdio>
+
+namespace cube {
+void fatal(const char *s, const char *o) {
+  fprintf(stderr, "%s%s\n", s, o);
+  exit(EXIT_FAILURE);
+}
+namespace ogl {
+#define GL_PROC(FIELD,NAME,PROTOTYPE) PROTOTYPE FIELD = NULL;
+#include "GL/ogl100.hxx"
+#include "GL/ogl110.hxx"
+#include "GL/ogl120.hxx"
+#include "GL/ogl130.hxx"
+#include "GL/ogl150.hxx"
+#include "GL/ogl200.hxx"
+#include "GL/ogl300.hxx"
+#undef GL_PROC
+} // namespace ogl
+
+#define CHECK(COND) do {\
+  if (!(COND)) {\
+    fprintf(stderr, "error with %s in function %s", #COND, __FUNCTION__);\
+    exit(EXIT_FAILURE);\
+  }\
+} while (0)
+
+using namespace ogl;
+
+void testqueries(void) {
+  record::install();
+  GLint status = GL_FALSE, viewport[4];
+  const u32 shader = CreateShader(GL_VERTEX_SHADER);
+  CHECK(shader != 0);
+  GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  CHECK(status == GL_TRUE);
+  CHECK(GetError() == GL_NO_ERROR);
+  Viewport(0, 0, 640, 480);
+  GetIntegerv(GL_VIEWPORT, viewport);
+  CHECK(viewport[2] == 640 && viewport[3] == 480);
+}
+
+void testframe(void) {
+  record::install();
+  u32 buffers[2], tex;
+  u8 data[1024];
+  GenBuffers(2, buffers);
+  CHECK(buffers[0] != buffers[1]);
+  BindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+  BufferData(GL_ARRAY_BUFFER, 1024, data, GL_STATIC_DRAW);
+  BindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+  BufferData(GL_ELEMENT_ARRAY_BUFFER, 512, NULL, GL_DYNAMIC_DRAW);
+  BufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, 256, data);
+  GenTextures(1, &tex);
+  BindTexture(GL_TEXTURE_2D, tex);
+  TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 16, 16, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+  BindTexture(GL_TEXTURE_2D, tex);
+  UseProgram(1);
+  UseProgram(1);
+  Enable(GL_DEPTH_TEST);
+  DepthFunc(GL_LESS);
+  Uniform1i(0, 1);
+  VertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 12, NULL);
+  DrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, NULL);
+  DrawArrays(GL_TRIANGLES, 0, 6);
+
+  const record::stats &s = record::frame();
+  CHECK(s.draws == 2 && s.elements == 42);
+  CHECK(s.buffers == 2 && s.textures == 2 && s.programs == 2);
+  CHECK(s.redundant == 2);
+  CHECK(s.states == 2 && s.uniforms == 1 && s.attribs == 1);
+  CHECK(s.uploaded == 1024+256+16*16*4);
+  CHECK(record::buffermemory() == 1024+512);
+  CHECK(record::texturememory() == 16*16*4);
+
+  // new frame: the counters restart but the totals and the objects stay
+  record::beginframe();
+  CHECK(record::frame().draws == 0);
+  DrawArrays(GL_TRIANGLES, 0, 3);
+  CHECK(record::total().draws == 3);
+  DeleteBuffers(1, buffers);
+  DeleteTextures(1, &tex);
+  CHECK(record::buffermemory() == 512);
+  CHECK(record::texturememory() == 0);
+}
+
+int main(void) {
+  testqueries();
+  testframe();
+  return 0;
+}
+#undef CHECK
+
+} // namespace cube
+
+int main(void) { return cube::main(); }
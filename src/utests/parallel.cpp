@@ -0,0 +1,86 @@
+#include "../base/parallel.hpp"
+#include <cstdio>
+
+namespace cube {
+
+#define CHECK(COND) do {\
+  if (!(COND)) {\
+    fprintf(stderr, "error with %s in function %s", #COND, __FUNCTION__);\
+    exit(EXIT_FAILURE);\
+  }\
+} while (0)
+
+// every index is visited exactly once
+void testfor(void) {
+  const u32 n = 100000;
+  vector<s32> visited(n);
+  loopi(s32(n)) visited[i] = 0;
+  atomic calls(0);
+  parallel_for(indexrange(0, n), 64, [&](const indexrange &r) {
+    CHECK(r.size() >= 64 || r.last == n);
+    rangei(r.first, r.last) visited[i]++;
+    calls++;
+  });
+  loopi(s32(n)) CHECK(visited[i] == 1);
+  CHECK(calls > 1);
+
+  // too small to be split
+  calls = 0;
+  parallel_for(indexrange(10, 20), 64, [&](const indexrange &r) {
+    CHECK(r.first == 10 && r.last == 20);
+    calls++;
+  });
+  CHECK(calls == 1);
+  parallel_for(indexrange(5, 5), 1, [&](const indexrange &r) { calls++; });
+  CHECK(calls == 1);
+}
+
+void testreduce(void) {
+  const u32 n = 1<<20;
+  const auto sum = [](u64 x, u64 y) { return x+y; };
+  const u64 s = parallel_reduce(indexrange(0, n), 256, u64(0), [](const indexrange &r) {
+    u64 partial = 0;
+    rangei(r.first, r.last) partial += u64(i);
+    return partial;
+  }, sum);
+  CHECK(s == u64(n)*u64(n-1)/2);
+
+  // partials are combined in order: concatenation is not commutative
+  const u32 m = 1000;
+  const auto first = parallel_reduce(indexrange(0, m), 1, indexrange(m, m),
+    [](const indexrange &r) { return r; },
+    [](const indexrange &x, const indexrange &y) {
+      if (x.size() == 0) return y;
+      CHECK(x.last == y.first);
+      return indexrange(x.first, y.last);
+    });
+  CHECK(first.first == 0 && first.last == m);
+}
+
+// loops started from the task threads
+void testnested(void) {
+  atomic total(0);
+  parallel_for(indexrange(0, 64), 1, [&](const indexrange &r) {
+    rangei(r.first, r.last)
+      parallel_for(indexrange(0, 1000), 10, [&](const indexrange &q) {
+        total += s32(q.size());
+      });
+  });
+  CHECK(total == 64*1000);
+}
+
+int main(void) {
+  const u32 threadnum = 3;
+  tasking::init(&threadnum,1);
+  testfor();
+  testreduce();
+  testnested();
+  tasking::clean();
+  return 0;
+}
+#undef CHECK
+
+} // namespace cube
+
+int main(void) { return cube::main(); }
+
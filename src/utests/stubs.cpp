@@ -0,0 +1,16 @@
+#include "../world.hpp"
+#include <cstdio>
+
+// the tests link the world code without the renderer
+namespace cube {
+void fatal(const char *s, const char *o) {
+  fprintf(stderr, "%s%s\n", s, o);
+  exit(EXIT_FAILURE);
+}
+namespace ogl {
+void deletetextures(s32 n, u32 *id) {}
+void deletebuffers(s32 n, u32 *id) {}
+void destroylightmapbake(lightmapbake *bake) {}
+} // namespace ogl
+} // namespace cube
+
@@ -1,4 +1,6 @@
 #include "../base/task.hpp"
+#include "../base/vector.hpp"
+#include <SDL/SDL.h>
 #include <cstdio>
 
 namespace cube {
@@ -76,6 +78,297 @@ void testsimpledepwithend(void) {
   loopi(tasknum) CHECK(jobsend[i]->x == somenumber);
 }
 
+// many tiny tasks scheduled and waited from the worker threads. this is where
+// the scheduler overhead shows up. default priority tasks go to the deques of
+// the threads while critical ones go through the shared ready list
+static const u32 spawnnum = 256, tinynum = 256;
+struct tinytask : public task {
+  tinytask(atomic &counter, u32 policy) : task("tiny", 1, 1, 0, policy), counter(counter) {}
+  void run(u32 elt) { ++counter; }
+  atomic &counter;
+};
+struct spawntask : public task {
+  spawntask(u32 policy) : task("spawn", spawnnum, 1, 0, policy), counter(0), policy(policy) {}
+  void run(u32 elt) {
+    ref<tinytask> tiny[tinynum];
+    loopi(s32(tinynum)) {
+      tiny[i] = NEW(tinytask, counter, policy);
+      tiny[i]->scheduled();
+    }
+    loopi(s32(tinynum)) tiny[i]->wait();
+  }
+  atomic counter;
+  u32 policy;
+};
+static float finegrained(u32 policy) {
+  const u64 start = microseconds();
+  ref<spawntask> job = NEW(spawntask, policy);
+  job->scheduled();
+  job->wait();
+  const u64 usec = max(microseconds()-start, u64(1));
+  CHECK(job->counter == s32(spawnnum*tinynum));
+  return float(spawnnum*tinynum)/float(usec);
+}
+void testfinegrained(void) {
+  const float deques = finegrained(task::LO_PRIO);
+  const float shared = finegrained(task::HI_PRIO);
+  printf("%d tiny tasks: %.2f Mtasks/s with the deques, %.2f Mtasks/s with the "
+    "shared ready list (x%.2f)\n", s32(spawnnum*tinynum), deques, shared, deques/shared);
+}
+
+// every element run by any thread shows up in the trace
+struct tracedtask : public task {
+  tracedtask(void) : task("traced", 1000, 1) {}
+  void run(u32 elt) {}
+};
+void testtrace(void) {
+  tasking::starttrace();
+  ref<tracedtask> job = NEWE(tracedtask);
+  job->scheduled();
+  job->wait();
+  tasking::stoptrace();
+  const char *name = "tasktrace.json";
+  const s32 n = tasking::dumptrace(name);
+  CHECK(n >= 1000);
+  FILE *f = fopen(name, "r");
+  CHECK(f != NULL);
+  s32 traced = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), f)) traced += strstr(line, "\"traced\"") != NULL;
+  fclose(f);
+  remove(name);
+  CHECK(traced == 1000);
+}
+
+// large graph with no intermediate barrier. node 0 starts all the others
+// and every node starts the sink. random edges go from a node to a later one
+static const u32 graphnum = 1000;
+static atomic stamp(0);
+struct graphnode : public task {
+  graphnode(u32 waiternum) : task("graphnode", 1, waiternum), started(0), finished(0) {}
+  void run(u32 elt) {
+    started = ++stamp;
+    finished = ++stamp;
+  }
+  s32 started, finished;
+};
+struct graphedge { u32 from, to; };
+void testlargegraph(void) {
+  vector<ref<graphnode>> nodes(graphnum);
+  vector<graphedge> edges;
+  loopi(s32(graphnum)) nodes[i] = NEW(graphnode, i == graphnum-1 ? 1 : 0);
+  rangei(1, s32(graphnum)-1) {
+    nodes[0]->starts(*nodes[i]);
+    nodes[i]->starts(*nodes[graphnum-1]);
+    edges.add({0u,u32(i)});
+    edges.add({u32(i),graphnum-1});
+  }
+  u32 seed = 1;
+  loopi(4*s32(graphnum)) {
+    seed = seed*1103515245u+12345u;
+    const u32 from = 1+(seed>>8)%(graphnum-3);
+    seed = seed*1103515245u+12345u;
+    const u32 to = from+1+(seed>>8)%(graphnum-2-from);
+    nodes[from]->starts(*nodes[to]);
+    edges.add({from,to});
+  }
+  loopi(s32(graphnum)) nodes[i]->scheduled();
+  nodes[graphnum-1]->wait();
+  loopv(edges) {
+    const graphnode &from = *nodes[edges[i].from], &to = *nodes[edges[i].to];
+    CHECK(from.finished != 0 && from.finished < to.started);
+  }
+}
+
+// the tests below never wait() since the waiting thread would run the tasks
+// itself. they sleep until the worker thread is done
+static void spin(u64 usec) {
+  const u64 end = microseconds()+usec;
+  while (microseconds() < end);
+}
+static void waituntil(const atomic &x, s32 value) { while (x != value) SDL_Delay(1); }
+
+struct spintask : public task {
+  spintask(u32 policy, u64 usec, atomic &done) :
+    task("spin", 1, 0, 0, policy), usec(usec), done(done), stamp(0) {}
+  void run(u32 elt) {
+    stamp = ++cube::stamp;
+    spin(usec);
+    ++done;
+  }
+  u64 usec;
+  atomic &done;
+  s32 stamp;
+};
+
+// block the worker thread until "released" is set
+struct blocktask : public task {
+  blocktask(void) : task("block", 1, 0), started(0), released(0) {}
+  void run(u32 elt) {
+    started = 1;
+    waituntil(released, 1);
+  }
+  atomic started, released;
+};
+
+// high priority tasks do not queue behind the background load. the worker is
+// blocked while both are queued so only the order is checked. less than 16
+// critical tasks keep the background class from starving
+void testpriority(void) {
+  const s32 bgnum = 64, hinum = 8;
+  atomic bgdone(0), hidone(0);
+  stamp = 0;
+  ref<blocktask> block = NEWE(blocktask);
+  block->scheduled();
+  waituntil(block->started, 1);
+  ref<spintask> bg[bgnum], hi[hinum];
+  loopi(bgnum) {
+    bg[i] = NEW(spintask, task::BG_PRIO, 200, bgdone);
+    bg[i]->scheduled();
+  }
+  loopi(hinum) {
+    hi[i] = NEW(spintask, task::HI_PRIO, 0, hidone);
+    hi[i]->scheduled();
+  }
+  const u64 start = microseconds();
+  block->released = 1;
+  waituntil(hidone, hinum);
+  const u64 latency = microseconds()-start;
+  waituntil(bgdone, bgnum);
+  loopi(hinum) loopj(bgnum) CHECK(hi[i]->stamp < bg[j]->stamp);
+  printf("high priority tasks done %d us after the release, before %d background tasks\n",
+    s32(latency), bgnum);
+}
+
+// a background task gets its turn while critical tasks keep coming
+void teststarvation(void) {
+  const s32 hinum = 200;
+  atomic bgdone(0), hidone(0);
+  stamp = 0;
+  ref<blocktask> block = NEWE(blocktask);
+  block->scheduled();
+  waituntil(block->started, 1);
+  ref<spintask> bg = NEW(spintask, task::BG_PRIO, 0, bgdone);
+  bg->scheduled();
+  loopi(hinum) {
+    ref<task> hi = NEW(spintask, task::HI_PRIO, 100, hidone);
+    hi->scheduled();
+  }
+  block->released = 1;
+  waituntil(hidone, hinum);
+  waituntil(bgdone, 1);
+  CHECK(bg->stamp <= 17); // a class may miss 16 picks
+}
+
+// earliest deadline first in a class, late tasks before anything else
+void testdeadline(void) {
+  const s32 num = 8;
+  atomic done(0);
+  stamp = 0;
+  ref<blocktask> block = NEWE(blocktask);
+  block->scheduled();
+  waituntil(block->started, 1);
+  const u64 now = microseconds(), later = now+3600*1000000ull;
+  ref<spintask> nodeadline = NEW(spintask, task::LO_PRIO, 0, done);
+  nodeadline->scheduled();
+  ref<spintask> jobs[num];
+  loopi(num) {
+    jobs[i] = NEW(spintask, task::LO_PRIO, 0, done);
+    jobs[i]->deadline(later+u64(num-i));
+    jobs[i]->scheduled();
+  }
+  ref<spintask> hi = NEW(spintask, task::HI_PRIO, 0, done);
+  hi->scheduled();
+  ref<spintask> late = NEW(spintask, task::BG_PRIO, 0, done);
+  late->deadline(now);
+  late->scheduled();
+  block->released = 1;
+  waituntil(done, num+3);
+  CHECK(late->stamp == 1 && hi->stamp == 2);
+  loopi(num) CHECK(jobs[i]->stamp == 2+num-i);
+  CHECK(nodeadline->stamp == num+3);
+}
+
+// enqueue to execution latency of a tiny task pushed to an idle thread, with
+// every idle policy. with the park policy, the producer sleeps until the task
+// ran so the thread is asleep by the next push. otherwise, it busy-waits and
+// pushes again while the thread still spins or yields
+struct stamptask : public task {
+  stamptask(void) : task("stamp", 1, 0), ran(0), usec(0) {}
+  void run(u32 elt) {
+    usec = microseconds();
+    ran = 1;
+  }
+  atomic ran;
+  u64 usec;
+};
+void testwakelatency(void) {
+  struct policy { const char *name; u32 spinnum, yieldnum; };
+  const policy policies[] = {{"park",0,0}, {"yield",0,1000}, {"spin",1000000,0}};
+  const s32 num = 100;
+  loopi(s32(sizeof(policies)/sizeof(policies[0]))) {
+    const policy &p = policies[i];
+    const bool park = p.spinnum+p.yieldnum == 0;
+    tasking::setidle(p.spinnum, p.yieldnum);
+    SDL_Delay(2);
+    tasking::resetidlestats();
+    u64 sum = 0, worst = 0;
+    loopj(num) {
+      ref<stamptask> job = NEWE(stamptask);
+      const u64 start = microseconds();
+      job->scheduled();
+      if (park)
+        waituntil(job->ran, 1);
+      else
+        while (job->ran != 1) yieldthread();
+      const u64 latency = job->usec-start;
+      sum += latency;
+      worst = max(worst, latency);
+    }
+    const tasking::idlestats stats = tasking::getidlestats();
+    printf("%s: wake latency %d us (mean), %d us (max). %u spin, %u yield, %u park wake-ups\n",
+      p.name, s32(sum/num), s32(worst), stats.spinwakes, stats.yieldwakes, stats.parkwakes);
+    if (park) CHECK(stats.parkwakes > 0);
+    else if (p.spinnum == 0) CHECK(stats.yieldwakes > 0);
+    else CHECK(stats.spinwakes > 0);
+  }
+  tasking::setidle(2000, 16);
+}
+
+// with no thread, the tasks only run when waited. nothing must stay alive once
+// they are done
+static atomic alive(0);
+struct countedtask : public task {
+  countedtask(u32 waiternum) : task("counted", 4, waiternum), x(0) { ++alive; }
+  virtual ~countedtask(void) { --alive; }
+  void run(u32 elt) { x++; }
+  atomic x;
+};
+void testnothreadleak(void) {
+  const u32 nothread = 0;
+  tasking::init(&nothread, 1);
+  loopi(1000) {
+    ref<countedtask> job = NEW(countedtask, 1u);
+    job->scheduled();
+    job->wait();
+    CHECK(job->x == 4);
+  }
+  loopi(100) {
+    ref<countedtask> first = NEW(countedtask, 0u), second = NEW(countedtask, 1u);
+    ref<countedtask> last = NEW(countedtask, 0u);
+    first->starts(*second);
+    last->ends(*second);
+    first->scheduled();
+    second->scheduled();
+    last->scheduled();
+    second->wait();
+    CHECK(first->x == 4 && second->x == 4 && last->x == 4);
+  }
+  CHECK(alive == 0);
+  tasking::clean();
+  CHECK(alive == 0);
+}
+
 int main(void) {
   const u32 threadnum = 1;
   tasking::init(&threadnum,1);
@@ -84,7 +377,15 @@ int main(void) {
   testsimpletaskboth();
   testsimpledep();
   testsimpledepwithend();
+  testfinegrained();
+  testtrace();
+  testlargegraph();
+  testpriority();
+  teststarvation();
+  testdeadline();
+  testwakelatency();
   tasking::clean();
+  testnothreadleak();
   return 0;
 }
 #undef CHECK
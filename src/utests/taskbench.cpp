@@ -0,0 +1,146 @@
+#include "../base/task.hpp"
+#include "../base/vector.hpp"
+#include <cstdio>
+#if defined(__WIN32__)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif // __WIN32__
+
+/*-------------------------------------------------------------------------
+ - benchmarks of the tasking system. every benchmark runs with 1 to N task
+ - threads (N is the first argument or the number of cores). the results go
+ - to stdout as csv: benchmark,threads,value,unit
+ -------------------------------------------------------------------------*/
+namespace cube {
+
+static u32 cpunum(void) {
+#if defined(__WIN32__)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return max(u32(info.dwNumberOfProcessors), 1u);
+#else
+  return max(u32(sysconf(_SC_NPROCESSORS_ONLN)), 1u);
+#endif // __WIN32__
+}
+
+static void result(const char *name, u32 threadnum, double value, const char *unit) {
+  printf("%s,%u,%.3f,%s\n", name, threadnum, value, unit);
+  fflush(stdout);
+}
+
+// waiting on a task runs it. the spawn benchmark only yields
+static void waituntil(const atomic &x, s32 value) { while (x != value) yieldthread(); }
+
+struct emptytask : public task {
+  emptytask(u32 elem=1, u32 waiternum=0) : task("empty", elem, waiternum) {}
+};
+struct counttask : public task {
+  counttask(atomic &counter) : task("count", 1, 0), counter(counter) {}
+  virtual void run(u32 elt) { ++counter; }
+  atomic &counter;
+};
+
+// cost of allocating and scheduling a task from the main thread
+static void benchspawn(u32 threadnum) {
+  const s32 num = 100000;
+  atomic done(0);
+  const u64 start = microseconds();
+  loopi(num) {
+    ref<task> job = NEW(counttask, done);
+    job->scheduled();
+  }
+  const u64 usec = microseconds()-start;
+  waituntil(done, num);
+  result("spawn", threadnum, 1000.0*double(usec)/double(num), "ns/task");
+}
+
+// empty tasks spawned and waited from the task threads
+static const u32 spawnernum = 256, childnum = 256;
+struct spawnertask : public task {
+  spawnertask(void) : task("spawner", spawnernum, 1) {}
+  virtual void run(u32 elt) {
+    ref<emptytask> children[childnum];
+    loopi(s32(childnum)) {
+      children[i] = NEW(emptytask, 1u, 1u);
+      children[i]->scheduled();
+    }
+    loopi(s32(childnum)) children[i]->wait();
+  }
+};
+static void benchthroughput(u32 threadnum) {
+  const u64 start = microseconds();
+  ref<task> job = NEWE(spawnertask);
+  job->scheduled();
+  job->wait();
+  const u64 usec = max(microseconds()-start, u64(1));
+  result("throughput", threadnum, double(spawnernum*childnum)/double(usec), "Mtasks/s");
+
+  // elements of one task set
+  const u32 elemnum = 1u<<22;
+  const u64 setstart = microseconds();
+  ref<task> set = NEW(emptytask, elemnum, 1u);
+  set->scheduled();
+  set->wait();
+  const u64 setusec = max(microseconds()-setstart, u64(1));
+  result("setthroughput", threadnum, double(elemnum)/double(setusec), "Melts/s");
+}
+
+// one root starts "width" empty tasks which all start the sink. the timing
+// goes from the root scheduling to the sink completion
+static void benchfan(u32 threadnum) {
+  const u32 width = 256, repeat = 100;
+  u64 total = 0;
+  loopi(s32(repeat)) {
+    ref<emptytask> root = NEWE(emptytask), sink = NEW(emptytask, 1u, 1u);
+    loopj(s32(width)) {
+      ref<emptytask> child = NEWE(emptytask);
+      root->starts(*child);
+      child->starts(*sink);
+      child->scheduled();
+    }
+    sink->scheduled();
+    const u64 start = microseconds();
+    root->scheduled();
+    sink->wait();
+    total += microseconds()-start;
+  }
+  result("fan", threadnum, double(total)/double(repeat), "us");
+}
+
+// every task of the chain starts the next one
+static void benchchain(u32 threadnum) {
+  const u32 length = 1000, repeat = 20;
+  vector<ref<emptytask>> chain(length);
+  u64 total = 0;
+  loopi(s32(repeat)) {
+    loopj(s32(length)) chain[j] = NEW(emptytask, 1u, j == s32(length)-1 ? 1u : 0u);
+    loopj(s32(length)-1) chain[j]->starts(*chain[j+1]);
+    rangej(1, s32(length)) chain[j]->scheduled();
+    const u64 start = microseconds();
+    chain[0]->scheduled();
+    chain[length-1]->wait();
+    total += microseconds()-start;
+  }
+  result("chain", threadnum, 1000.0*double(total)/double(repeat*length), "ns/task");
+}
+
+int main(int argc, char **argv) {
+  const u32 maxthreadnum = argc > 1 ? max(u32(atoi(argv[1])), 1u) : cpunum();
+  printf("benchmark,threads,value,unit\n");
+  rangei(1, s32(maxthreadnum)+1) {
+    const u32 threadnum = i;
+    tasking::init(&threadnum, 1);
+    benchspawn(threadnum);
+    benchthroughput(threadnum);
+    benchfan(threadnum);
+    benchchain(threadnum);
+    tasking::clean();
+  }
+  return 0;
+}
+
+} // namespace cube
+
+int main(int argc, char **argv) { return cube::main(argc, argv); }
+
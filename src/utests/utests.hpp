@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+
+// abort the test when the condition does not hold
+#define CHECK(COND) do {\
+  if (!(COND)) {\
+    fprintf(stderr, "error with %s in function %s", #COND, __FUNCTION__);\
+    exit(EXIT_FAILURE);\
+  }\
+} while (0)
+
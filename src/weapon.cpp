@@ -264,7 +264,7 @@ void raydamage(dynent *o, vec3f &from, vec3f &to, dynent *d, int i) {
   else if (intersect(o, from, to)) hitpush(i, qdam, o, d, from, to);
 }
 
-void shoot(dynent *d, vec3f &targ) {
+void shoot(dynent *d, const vec3f &targ) {
   int attacktime = game::lastmillis()-d->lastaction;
   if (attacktime<d->gunwait) return;
   d->gunwait = 0;
@@ -295,6 +295,14 @@ void shoot(dynent *d, vec3f &targ) {
   }
   if (d->gunselect==GUN_SG) createrays(from, to);
 
+  // shots stop on the world. trace all the rays of the shot at once
+  world::raybatch batch;
+  batch.add(from, to);
+  if (d->gunselect==GUN_SG) loopi(SGRAYS) batch.add(from, sg[i]);
+  batch.trace();
+  to = batch.hitpoint(0);
+  if (d->gunselect==GUN_SG) loopi(SGRAYS) sg[i] = batch.hitpoint(i+1);
+
   if (d->quadmillis && attacktime>200) sound::playc(sound::ITEMPUP);
   shootv(d->gunselect, from, to, d, true);
   if (!d->monsterstate) {
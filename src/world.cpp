@@ -3,6 +3,8 @@
 #include "cube.hpp"
 #include "bvh.hpp"
 #include "base/task.hpp"
+#include "base/parallel.hpp"
+#include "brickmesh.hpp"
 
 namespace cube {
 namespace world {
@@ -128,8 +130,6 @@ static void clearents(char *name) {
 }
 COMMAND(clearents, ARG_1STR);
 
-int isoccluded(float vx, float vy, float cx, float cy, float csize) {return 0;}
-
 static string cgzname, bakname, pcfname, mcfname;
 
 struct deletegrid {
@@ -140,9 +140,15 @@ struct deletegrid {
     }
   }
 };
+static bvh::intersector *worldbvh = NULL;
+const bvh::intersector *getbvh(void) { return worldbvh; }
+
 static void empty(void) {
+  if (worldbvh) bvh::destroy(worldbvh);
+  worldbvh = NULL;
   forallgrids(deletegrid());
   MEMZERO(root.elem);
+  root.occ = 0;
   root.dirty = 1;
 }
 void clean(void) { empty(); }
@@ -312,6 +318,51 @@ COMMANDN(savemap, save, ARG_1STR);
 lvl3grid root;
 
 brickcube getcube(const vec3i &xyz) {return world::root.get(xyz);}
+void snapshot(bricksnapshot &s, vec3i org) {
+  const vec3i halo(bricksnapshot::halo);
+  s.org = org;
+  loopxyz(org-halo, org+brickisize+halo, s.set(xyz, root.get(xyz)));
+}
+// cells are counted from the occupancy masks of the bricks. each visible face
+// of a solid cell takes the texture of the first cube showing this face
+void snapshot(lodsnapshot &s, vec3i org) {
+  static const u8 bits[16] = {0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4};
+  static_assert(lodcell==4, "occupancy is counted by nibbles");
+  const int halo = lodsnapshot::halo;
+  s.org = org;
+  for (int x = -halo; x < lodcells+halo; ++x)
+  for (int y = -halo; y < lodcells+halo; ++y)
+  for (int z = -halo; z < lodcells+halo; ++z) {
+    const vec3i cell(x,y,z), p = org+lodcell*cell;
+    const lvl1grid *b = getbrick(p);
+    const vec3i q = p%brickisize;
+    int n = 0;
+    if (b != NULL) loopi(lodcell) loopj(lodcell) n += bits[(b->occ[q.y+i][q.z+j]>>q.x)&0xf];
+    const bool solid = 4*n >= lodcell*lodcell*lodcell;
+    s.cells[x+halo][y+halo][z+halo] = solid;
+    if (!solid || any(cell<vec3i(zero)) || any(cell>=vec3i(lodcells))) continue;
+    cubetex &tex = s.tex[x][y][z];
+    u32 found = 0;
+    bool first = true;
+    loopi(lodcell) loopj(lodcell) loopk(lodcell) {
+      const vec3i c = q+vec3i(i,j,k);
+      if (!b->occupied(c)) continue;
+      const brickcube cube = b->get(c);
+      if (first) tex = cube.tex;
+      first = false;
+      const u32 m = b->visiblefaces(c) & ~found;
+      loopl(6) if ((m>>l)&1) tex[l] = cube.tex[l];
+      found |= m;
+    }
+  }
+}
+lvl1grid *getbrick(const vec3i &xyz) {
+  const vec3i idx2 = root.index(xyz);
+  const lvl2grid *g = root.subgrid(idx2);
+  if (g == NULL) return NULL;
+  const vec3i p = xyz-idx2*root.subcuben();
+  return g->subgrid(g->index(p));
+}
 void setcube(const vec3i &xyz, const brickcube &cube) {
   root.set(xyz, cube);
   const vec3i m = xyz % brickisize;
@@ -328,11 +379,15 @@ template <typename T> struct gridpolicy {
   static INLINE vec3f cellorg(vec3f boxorg, vec3i xyz, vec3f cellsize) {
     return boxorg+vec3f(xyz)*cellsize;
   }
+  static INLINE int emptyrun(const T*, vec3i, int) { return 1; }
 };
 template <> struct gridpolicy<lvl1grid> {
   static INLINE vec3f cellorg(vec3f boxorg, vec3i xyz, vec3f cellsize) {
     return vec3f(zero);
   }
+  static INLINE int emptyrun(const lvl1grid *grid, vec3i xyz, int step) {
+    return grid->emptyrun(xyz, step);
+  }
 };
 INLINE isecres intersect(const brickcube &cube, const vec3f&, const ray&, float t) {
   return isecres(cube.mat==FULL, t);
@@ -340,7 +395,7 @@ INLINE isecres intersect(const brickcube &cube, const vec3f&, const ray&, float
 
 template <typename G>
 INLINE isecres intersect(const G *grid, const vec3f &boxorg, const ray &ray, float t) {
-  if (grid == NULL) return isecres(false);
+  if (grid == NULL || grid->isempty()) return isecres(false);
   const vec3b signs = ray.dir > vec3f(zero);
   const vec3f rdir = rcp(ray.dir);
   const vec3f cellsize = grid->subcuben();
@@ -355,9 +410,23 @@ INLINE isecres intersect(const G *grid, const vec3f &boxorg, const ray &ray, flo
   tmax = select(ray.dir==vec3f(zero),vec3f(FLT_MAX),tmax);
 
   for (;;) {
-    const vec3f cellorg = gridpolicy<G>::cellorg(boxorg, xyz, cellsize);
-    const auto isec = intersect(grid->fastsubgrid(xyz), cellorg, ray, t);
-    if (isec.isec) return isec;
+    if (grid->nonempty(xyz)) {
+      const vec3f cellorg = gridpolicy<G>::cellorg(boxorg, xyz, cellsize);
+      const auto isec = intersect(grid->fastsubgrid(xyz), cellorg, ray, t);
+      if (isec.isec) return isec;
+    } else if (tmax.x < tmax.y && tmax.x < tmax.z) {
+      // skip the empty run along x but never go past a y or z crossing
+      const int run = gridpolicy<G>::emptyrun(grid, xyz, step.x);
+      if (run > 1) {
+        const float m = min((min(tmax.y,tmax.z)-tmax.x)/delta.x, float(G::l));
+        const int n = min(run, int(ceilf(m))+1);
+        if (n > 1) {
+          xyz.x += (n-1)*step.x;
+          t = tmax.x+float(n-2)*delta.x;
+          tmax.x += float(n-1)*delta.x;
+        }
+      }
+    }
     if (tmax.x < tmax.y) {
       if (tmax.x < tmax.z) {
         xyz.x += step.x;
@@ -400,17 +469,14 @@ VAR(usebvh,0,0,1);
 
 namespace {
 struct addcube {
-  INLINE addcube(vector<bvh::primitive> &prims) : prims(&prims), trinum(0), boxnum(0) {}
+  INLINE addcube(vector<bvh::primitive> &prims, const lvl1grid &b, vec3i org) :
+    prims(&prims), b(&b), org(org), trinum(0), boxnum(0) {}
   void operator () (const brickcube &c, const vec3i &xyz) const {
-    if (c.mat == EMPTY) return;
-
-    // figure out if the cube is visible and which faces are visible
-    bool visible[6], anyvisible = false;
-    loopk(6) {
-      visible[k] = getcube(xyz+cubenorms[k]).mat == world::EMPTY;
-      if (visible[k]) anyvisible = true;
-    }
-    if (!anyvisible) return;
+    // the brick build already figured out which faces are visible
+    const u32 faces = b->visiblefaces(xyz-org);
+    if (faces == 0) return;
+    bool visible[6];
+    loopk(6) visible[k] = (faces>>k)&1;
 
     // figure out if the cube is unchanged (i.e. not deformed)
     vec3f vertices[8];
@@ -474,6 +540,8 @@ struct addcube {
     }
   }
   vector<bvh::primitive> *prims;
+  const lvl1grid *b;
+  vec3i org;
   mutable u32 trinum, boxnum;
 };
 }
@@ -490,7 +558,7 @@ bvh::intersector *buildbvh(void) {
   if (twolevelbvh) {
     forallbricks([&](lvl1grid &b, vec3i org) {
       vector<bvh::primitive> prims;
-      auto functor = addcube(prims);
+      auto functor = addcube(prims, b, org);
       b.forallcubes(functor, org);
       if (prims.size() > 0) {
         auto prim = bvh::primitive(bvh::create(&prims[0], prims.size()));
@@ -502,7 +570,12 @@ bvh::intersector *buildbvh(void) {
   }
   // build one bvh only
   else
-    forallcubes(addcube(bvhprims));
+    forallbricks([&](lvl1grid &b, vec3i org) {
+      auto functor = addcube(bvhprims, b, org);
+      b.forallcubes(functor, org);
+      boxnum += functor.boxnum;
+      trinum += functor.trinum;
+    });
 
   console::out("bvh: %i generated primitives with %i boxes and %i triangles (%i ms elapsed)",
     bvhprims.size(), boxnum, trinum, SDL_GetTicks()-start);
@@ -515,8 +588,75 @@ bvh::intersector *buildbvh(void) {
     return NULL;
 }
 
+void updatebvh(void) {
+  if (worldbvh) bvh::destroy(worldbvh);
+  worldbvh = buildbvh();
+}
+
+/*-------------------------------------------------------------------------
+ - batched ray queries
+ -------------------------------------------------------------------------*/
+void raybatch::trace(void) {
+  const s32 n = rays.size();
+  res.resize(n);
+  if (n == 0) return;
+
+  // no bvh yet. just use the grid
+  if (worldbvh == NULL) {
+    loopi(n) {
+      const isecres isec = castray(rays[i]);
+      res[i] = isec.isec && isec.t < rays[i].tfar ? isec : isecres(false, rays[i].tfar);
+    }
+    return;
+  }
+
+  // sort the rays per direction octant to get coherent packets
+  const auto octant = [&](s32 i) {
+    const vec3f &d = rays[i].dir;
+    return (d.x>=0.f?1:0) | (d.y>=0.f?2:0) | (d.z>=0.f?4:0);
+  };
+  s32 first[9];
+  MEMZERO(first);
+  loopi(n) ++first[octant(i)+1];
+  loopi(8) first[i+1] += first[i];
+  vector<s32> order(n);
+  loopi(n) order[first[octant(i)]++] = i;
+
+  raypacket p;
+  bvh::packethit hit;
+  for (s32 start = 0; start < n; start += p.raynum) {
+    const s32 oct = octant(order[start]);
+    const vec3f org = rays[order[start]].org;
+    vec3f mindir(FLT_MAX), maxdir(-FLT_MAX);
+    bool commonorg = true;
+    p.raynum = 0;
+    while (start+s32(p.raynum) < n && p.raynum < raypacket::MAXRAYNUM) {
+      const s32 id = order[start+p.raynum];
+      if (octant(id) != oct) break;
+      const ray &r = rays[id];
+      p.setorg(r.org, p.raynum);
+      p.setdir(r.dir, p.raynum);
+      hit[p.raynum] = bvh::hit(r.tfar);
+      commonorg = commonorg && all(r.org==org);
+      mindir = min(mindir, r.dir);
+      maxdir = max(maxdir, r.dir);
+      ++p.raynum;
+    }
+    p.flags = commonorg ? raypacket::COMMONORG : 0;
+    if (commonorg && all(mindir*maxdir > vec3f(zero))) {
+      p.iadir = makeinterval(mindir, maxdir);
+      p.iardir = rcp(p.iadir);
+      p.iaorg = makeinterval(org, org);
+      p.flags |= raypacket::INTERVALARITH;
+    }
+    bvh::closest(*worldbvh, p, hit);
+    loopi(s32(p.raynum)) {
+      const s32 id = order[start+i];
+      res[id] = hit[i].is_hit() ? isecres(true, hit[i].t) : isecres(false, rays[id].tfar);
+    }
+  }
+}
 
-VAR(mtraycast, 0, 0, 1);
 #if 0
 struct raycasttask : public task {
   raycasttask(bvh::intersector *bvhisec, const camera &cam, int *pixels, u32 w, u32 h) :
@@ -541,52 +681,43 @@ struct raycasttask : public task {
 };
 #else
 #define TILESIZE 16
-struct raycasttask : public task {
-  raycasttask(bvh::intersector *bvhisec, const camera &cam, int *pixels, vec2i dim, vec2i tile) :
-    task("raycasttask", tile.x*tile.y, 1, 0, UNFAIR), bvhisec(bvhisec), cam(cam), pixels(pixels), dim(dim), tile(tile)
-  {}
-  virtual void run(u32 tileID) {
-    const vec2i tilexy(tileID%tile.x, tileID/tile.x);
-    const vec2i screen = TILESIZE * tilexy;
-    raypacket p;
-    vec3f mindir(FLT_MAX), maxdir(-FLT_MAX);
-    for (u32 y = 0; y < TILESIZE; ++y)
-    for (u32 x = 0; x < TILESIZE; ++x) {
-      const ray ray = cam.generate(dim.x, dim.y, screen.x+x, screen.y+y);
-      const int idx = x+y*TILESIZE;
-      p.setdir(ray.dir, idx);
-      p.setorg(cam.org, idx);
-      mindir = min(mindir, ray.dir);
-      maxdir = max(maxdir, ray.dir);
-    }
-    p.raynum = TILESIZE*TILESIZE;
-    p.flags = raypacket::COMMONORG;
-    if (all(mindir*maxdir > vec3f(zero))) {
-      p.iadir = makeinterval(mindir, maxdir);
-      p.iardir = rcp(p.iadir);
-      p.iaorg = makeinterval(cam.org, cam.org);
-      p.flags |= raypacket::INTERVALARITH;
-    }
+static void raycasttile(bvh::intersector *bvhisec, const camera &cam, int *pixels,
+                        vec2i dim, vec2i tile, u32 tileID) {
+  const vec2i tilexy(tileID%tile.x, tileID/tile.x);
+  const vec2i screen = TILESIZE * tilexy;
+  raypacket p;
+  vec3f mindir(FLT_MAX), maxdir(-FLT_MAX);
+  for (u32 y = 0; y < TILESIZE; ++y)
+  for (u32 x = 0; x < TILESIZE; ++x) {
+    const ray ray = cam.generate(dim.x, dim.y, screen.x+x, screen.y+y);
+    const int idx = x+y*TILESIZE;
+    p.setdir(ray.dir, idx);
+    p.setorg(cam.org, idx);
+    mindir = min(mindir, ray.dir);
+    maxdir = max(maxdir, ray.dir);
+  }
+  p.raynum = TILESIZE*TILESIZE;
+  p.flags = raypacket::COMMONORG;
+  if (all(mindir*maxdir > vec3f(zero))) {
+    p.iadir = makeinterval(mindir, maxdir);
+    p.iardir = rcp(p.iadir);
+    p.iaorg = makeinterval(cam.org, cam.org);
+    p.flags |= raypacket::INTERVALARITH;
+  }
 
-    bvh::packethit hit;
-    closest(*bvhisec, p, hit);
-    for (u32 y = 0; y < TILESIZE; ++y)
-    for (u32 x = 0; x < TILESIZE; ++x) {
-      const int offset = (screen.x+x)+dim.x*(screen.y+y);
-      const int idx = x+y*TILESIZE;
-      if (hit[idx].is_hit()) {
-        const int d = min(int(hit[idx].t), 255);
-        pixels[offset] = d|(d<<8)|(d<<16)|(0xff<<24);
-      } else
-        pixels[offset] = 0;
-    }
+  bvh::packethit hit;
+  closest(*bvhisec, p, hit);
+  for (u32 y = 0; y < TILESIZE; ++y)
+  for (u32 x = 0; x < TILESIZE; ++x) {
+    const int offset = (screen.x+x)+dim.x*(screen.y+y);
+    const int idx = x+y*TILESIZE;
+    if (hit[idx].is_hit()) {
+      const int d = min(int(hit[idx].t), 255);
+      pixels[offset] = d|(d<<8)|(d<<16)|(0xff<<24);
+    } else
+      pixels[offset] = 0;
   }
-  bvh::intersector *bvhisec;
-  const camera &cam;
-  int *pixels;
-  vec2i dim;
-  vec2i tile;
-};
+}
 
 #endif
 
@@ -594,31 +725,28 @@ void castray(float fovy, float aspect, float farplane) {
   using namespace game;
   const int w = 1024, h = 1024;
   int *pixels = (int*)MALLOC(w*h*sizeof(int));
-  const mat3x3f r = mat3x3f::rotate(vec3f(0.f,0.f,1.f),game::player1->yaw)*
-                    mat3x3f::rotate(vec3f(0.f,1.f,0.f),game::player1->roll)*
-                    mat3x3f::rotate(vec3f(-1.f,0.f,0.f),game::player1->pitch);
-  const camera cam(game::player1->o, -r.vz, -r.vy, fovy, aspect);
+  const mat3x3f r = mat3x3f::rotate(vec3f(0.f,0.f,1.f),game::viewer()->yaw)*
+                    mat3x3f::rotate(vec3f(0.f,1.f,0.f),game::viewer()->roll)*
+                    mat3x3f::rotate(vec3f(-1.f,0.f,0.f),game::viewer()->pitch);
+  const camera cam(game::viewer()->o, -r.vz, -r.vy, fovy, aspect);
   const vec3f cellsize(one), boxorg(zero);
   const aabb box(boxorg, cellsize*vec3f(root.global()));
   bvh::intersector *bvhisec = NULL;
   int start = 0;
-  ref<task> isectask = NULL;
 
   if (usebvh) {
     bvhisec = buildbvh();
-    const u32 threadnum = mtraycast ? 3 : 0;
-    tasking::init(&threadnum, 1);
     start = SDL_GetTicks();
 #if 0
-    isectask = NEW(raycasttask, bvhisec, cam, pixels, w, h);
+    ref<task> isectask = NEW(raycasttask, bvhisec, cam, pixels, w, h);
     isectask->scheduled();
     isectask->wait();
 #else
     const vec2i dim(w,h);
     const vec2i tile = dim/TILESIZE;
-    isectask = NEW(raycasttask, bvhisec, cam, pixels, dim, tile);
-    isectask->scheduled();
-    isectask->wait();
+    parallel_for(indexrange(0, tile.x*tile.y), 1, [&](const indexrange &r) {
+      rangei(r.first, r.last) raycasttile(bvhisec, cam, pixels, dim, tile, i);
+    });
 #endif
 
   } else {
@@ -658,7 +786,6 @@ void castray(float fovy, float aspect, float farplane) {
   writebmp(pixels, w, h, usebvh ? "bvh.bmp" : "grid.bmp");
   FREE(pixels);
   if (bvhisec) bvh::destroy(bvhisec);
-  if (usebvh) tasking::clean();
 }
 
 } // namespace world
@@ -64,6 +64,12 @@ struct log2 {
 };
 template<> struct log2<1> {enum {value=0};};
 
+// brick mesh built by the task threads and waiting to be uploaded
+struct meshblob;
+void deletemeshblob(meshblob *blob);
+// uploaded mesh suballocated in the mesh pools
+void freemesh(u32 slot);
+
 // actually contains the data (geometries)
 template <int sz>
 struct brick : public noncopyable {
@@ -73,12 +79,20 @@ struct brick : public noncopyable {
     subcubenumber=1,
     l=sz
   };
-  brick(void) : vbo(0), ibo(0), lm(0), dirty(1) {}
+  static_assert(sz<=16,"occupancy rows are stored in 16 bits");\
+  brick(void) : occnum(0), slot(0), lm(0), pendinglm(0), bake(NULL), mesh(NULL), dirty(1) {
+    MEMZERO(occ);
+    MEMZERO(faces);
+  }
   ~brick(void) {
-    if (ibo) ogl::deletebuffers(1,&ibo);
-    if (vbo) ogl::deletebuffers(1,&vbo);
+    freemesh(slot);
     if (lm)  ogl::deletetextures(1,&lm);
-    lm=ibo=vbo=0;
+    if (pendinglm) ogl::deletetextures(1,&pendinglm);
+    if (bake) ogl::destroylightmapbake(bake);
+    if (mesh) deletemeshblob(mesh);
+    lm=pendinglm=slot=0;
+    bake=NULL;
+    mesh=NULL;
   }
   static INLINE vec3i size(void) { return vec3i(sz); }
   static INLINE vec3i global(void) { return size(); }
@@ -90,7 +104,38 @@ struct brick : public noncopyable {
   INLINE brickcube fastsubgrid(vec3i v) const { return subgrid(v); }
   INLINE void set(vec3i v, const brickcube &cube) {
     dirty=1;
-    elem[v.x][v.y][v.z]=cube;
+    auto &c = elem[v.x][v.y][v.z];
+    const u16 bit = 1<<v.x;
+    occnum += s32(cube.mat!=EMPTY) - s32(c.mat!=EMPTY);
+    if (cube.mat != EMPTY)
+      occ[v.y][v.z] |= bit;
+    else
+      occ[v.y][v.z] &= ~bit;
+    c=cube;
+  }
+  INLINE bool nonempty(vec3i v) const { return (occ[v.y][v.z]>>v.x)&1; }
+  INLINE bool occupied(vec3i v) const { return nonempty(v); }
+  INLINE bool isempty(void) const { return occnum==0; }
+  INLINE u32 visiblefaces(vec3i v) const { return faces[v.x][v.y][v.z]; }
+  // true if one cube in [pmin,pmax) is not empty
+  INLINE bool anyoccupied(vec3i pmin, vec3i pmax) const {
+    pmin = max(pmin, vec3i(zero));
+    pmax = min(pmax, size());
+    if (any(pmin>=pmax)) return false;
+    const u32 m = ((1u<<pmax.x)-1u) & ~((1u<<pmin.x)-1u);
+    range(y, pmin.y, pmax.y) range(z, pmin.z, pmax.z) if (occ[y][z]&m) return true;
+    return false;
+  }
+  // number of consecutive empty cubes along x from v (included) to the border
+  INLINE int emptyrun(vec3i v, int step) const {
+    const u32 row = occ[v.y][v.z];
+    if (step > 0) {
+      const u32 m = row>>v.x;
+      return m ? int(bsf(m)) : sz-v.x;
+    } else {
+      const u32 m = row & ((2u<<v.x)-1u);
+      return m ? v.x-int(bsr(m)) : v.x+1;
+    }
   }
   INLINE brick &getbrick(vec3i idx) { return *this; }
   template <typename F> INLINE void forallcubes(const F &f, vec3i org) {
@@ -102,14 +147,26 @@ struct brick : public noncopyable {
   template <typename F> INLINE void forallbricks(const F &f, vec3i org) {
     f(*this, org);
   }
+  template <typename C, typename F>
+  INLINE void forallvisiblebricks(const C &cull, const F &f, vec3i org) {
+    f(*this, org);
+  }
   template <typename F> INLINE void forallgrids(const F &f, vec3i org) {
     f(*this, org);
   }
   brickcube elem[sz][sz][sz];
-  u32 vbo, ibo; // ogl handles for vertex and index buffers
+  u16 occ[sz][sz]; // bit x of occ[y][z] is set if cube (x,y,z) is not empty
+  u8 faces[sz][sz][sz]; // bit k is set if face k is visible. updated by builds
+  u32 occnum; // number of non-empty cubes
+  u32 slot; // location of the uploaded mesh in the mesh pools. 0 if none
   u32 lm; // light map
   vec2f rlmdim; // rcp(lightmap_dimension)
+  u32 pendinglm; // light map of the pending mesh. swapped with it (0 if none)
+  vec2f pendingrlmdim;
+  ogl::lightmapbake *bake; // cpu light map and its pending refinement
+  meshblob *mesh; // non-null while the new mesh is not uploaded yet
   vector<vec2i> draws; // (elemnum, texid)
+  vector<aabb> occluders; // flat rectangles of faces (world space)
   u32 dirty; // 1 if the ogl data need to be rebuilt
 };
 
@@ -122,7 +179,7 @@ struct grid : public noncopyable {
     subcubenumber=T::cubenumber,
     l=loc
   };
-  INLINE grid(void) { dirty=1; memset(elem, 0, sizeof(elem)); }
+  INLINE grid(void) : occ(0) { dirty=1; memset(elem, 0, sizeof(elem)); }
   static INLINE vec3i local(void) { return vec3i(loc); }
   static INLINE vec3i global(void) { return vec3i(glob); }
   static INLINE vec3i cuben(void) { return vec3i(cubenumber); }
@@ -150,8 +207,34 @@ struct grid : public noncopyable {
     auto &e = elem[idx.x][idx.y][idx.z];
     if (e == NULL) e = NEWE(T);
     e->set(v-idx*subcuben(), cube);
+    const u64 bit = u64(1)<<bitindex(idx);
+    if (e->isempty())
+      occ &= ~bit;
+    else
+      occ |= bit;
     dirty=1;
   }
+  static INLINE u32 bitindex(vec3i idx) { return (idx.x*loc+idx.y)*loc+idx.z; }
+  INLINE bool nonempty(vec3i idx) const { return (occ>>bitindex(idx))&1; }
+  INLINE bool isempty(void) const { return occ==0; }
+  INLINE bool occupied(vec3i v) const {
+    auto idx = index(v);
+    if (any(idx>=local()) || !nonempty(idx)) return false;
+    return fastsubgrid(idx)->occupied(v-idx*subcuben());
+  }
+  // true if one cube in [pmin,pmax) is not empty
+  INLINE bool anyoccupied(vec3i pmin, vec3i pmax) const {
+    pmin = max(pmin, vec3i(zero));
+    pmax = min(pmax, cuben());
+    if (occ==0 || any(pmin>=pmax)) return false;
+    const vec3i imin = pmin/subcuben(), imax = (pmax-vec3i(one))/subcuben();
+    loopxyz(imin, imax+vec3i(one), {
+      if (!nonempty(xyz)) continue;
+      const vec3i org = xyz*subcuben();
+      if (fastsubgrid(xyz)->anyoccupied(pmin-org, pmax-org)) return true;
+    });
+    return false;
+  }
   template <typename F> INLINE void forallcubes(const F &f, vec3i org) {
     loopxyz(zero, local(), if (T *e = subgrid(xyz))
       e->forallcubes(f, org + xyz*global()/local()));
@@ -165,8 +248,23 @@ struct grid : public noncopyable {
       e->forallgrids(f, org + xyz*global()/local()););
     f(*this,org);
   }
+  // subgrids outside the frustum are rejected at once. the ones inside do not
+  // need any more test
+  template <typename C, typename F>
+  INLINE void forallvisiblebricks(const C &cull, const F &f, vec3i org) {
+    loopxyz(zero, local(), if (T *e = subgrid(xyz)) {
+      const vec3i suborg = org + xyz*global()/local();
+      const u32 res = cull(suborg, T::cuben());
+      if (res == frustum::INSIDE)
+        e->forallbricks(f, suborg);
+      else if (res == frustum::INTERSECT)
+        e->forallvisiblebricks(cull, f, suborg);
+    });
+  }
   T *elem[loc][loc][loc]; // each element may be null when empty
+  u64 occ; // bitindex(idx) is set if child idx contains non-empty cubes
   u32 dirty:1; // true if anything changed in the child grids
+  static_assert(loc*loc*loc<=64,"occupancy mask is stored in 64 bits");\
   static_assert(powerof2policy<loc>::value,"grid dimensions must be power of 2");\
   static_assert(powerof2policy<glob>::value,"grid dimensions must be power of 2");\
 };
@@ -201,12 +299,39 @@ template <typename F> static void forallgrids(const F &f) { root.forallgrids(f,
 template <typename F> static void forallbricks(const F &f) { root.forallbricks(f, zero); }
 template <typename F> static void forallcubes(const F &f) { root.forallcubes(f, zero); }
 
+// classify world boxes against a frustum given in opengl space (i.e. x,z,y).
+// boxes are extended by one cube since vertices may be displaced
+struct frustumculler {
+  INLINE frustumculler(const frustum &fr) : fr(fr), tests(0) {}
+  INLINE u32 operator() (vec3i org, vec3i size) const {
+    ++tests;
+    const vec3f pmin = vec3f(org)-vec3f(one), pmax = vec3f(org+size)+vec3f(one);
+    return fr.classify(aabb(pmin.xzy(), pmax.xzy()));
+  }
+  const frustum &fr;
+  mutable u32 tests;
+};
+// return the number of tested nodes
+template <typename F> static u32 forallvisiblebricks(const frustum &fr, const F &f) {
+  const frustumculler cull(fr);
+  root.forallvisiblebricks(cull, f, zero);
+  return cull.tests;
+}
+
 // get and set the cube at position (x,y,z)
 brickcube getcube(const vec3i &xyz);
 void setcube(const vec3i &xyz, const brickcube &cube);
+// brick containing the cube at position (x,y,z) (null if none)
+lvl1grid *getbrick(const vec3i &xyz);
+// occupancy queries only look at the bit masks of the hierarchy
+INLINE bool occupied(const vec3i &xyz) { return root.occupied(xyz); }
+INLINE bool anyoccupied(const vec3i &pmin, const vec3i &pmax) {
+  return root.anyoccupied(pmin, pmax);
+}
+// visible faces are only up-to-date once dirty bricks are built
 INLINE bool visibleface(vec3i xyz, u32 face) {
-  return getcube(xyz).mat != world::EMPTY &&
-         getcube(xyz+cubenorms[face]).mat == world::EMPTY;
+  const lvl1grid *b = getbrick(xyz);
+  return b && ((b->visiblefaces(xyz%brickisize)>>face)&1);
 }
 INLINE vec3f getpos(vec3i xyz) {return vec3f(xyz)+vec3f(world::getcube(xyz).p)/255.f;}
 // cast a ray in the world and return the intersection result
@@ -229,8 +354,16 @@ void save(const char *fname);
 void load(const char *mname);
 void writemap(const char *mname, int msize, u8 *mdata);
 u8 *readmap(const char *mname, int *msize);
-// test occlusion for a cube (v = viewer, c = cube to test)
-int isoccluded(float vx, float vy, float cx, float cy, float csize);
+// software occlusion culling. the occluders of the given bricks (rectangles
+// of at least minarea faces) are rasterized with the view projection (opengl
+// space). queries return false outside of begin/endocclusion
+void beginocclusion(const mat4x4f &viewproj, float minarea);
+void addoccluders(const lvl1grid &b);
+void endocclusion(void);
+// true if the box (opengl space) is hidden by the occluders
+bool isoccluded(const aabb &box);
+// boxes tested and culled since the last beginocclusion
+void occlusionstats(u32 &tested, u32 &culled);
 // return the water level for the loaded map
 int waterlevel(void);
 // return the name of the current map
@@ -239,6 +372,35 @@ char *maptitle(void);
 void clean(void);
 // build a bvh from the world
 bvh::intersector *buildbvh(void);
+// rebuild the bvh used by the world ray queries
+void updatebvh(void);
+// bvh of the current world (may be null)
+const bvh::intersector *getbvh(void);
+
+// rays gathered during a frame and traced at once. rays are sorted by
+// direction and traced with packets through the world bvh
+struct raybatch {
+  INLINE u32 add(const ray &r) {
+    rays.add(r);
+    return rays.size()-1;
+  }
+  // segment from "from" to "to"
+  INLINE u32 add(const vec3f &from, const vec3f &to) {
+    const float len = distance(from, to);
+    if (len < 1e-6f) return add(ray(from, vec3f(0.f,0.f,1.f), 0.f, 0.f));
+    return add(ray(from, (to-from)/len, 0.f, len));
+  }
+  void trace(void);
+  INLINE void clear(void) { rays.resize(0); res.resize(0); }
+  INLINE u32 size(void) const { return rays.size(); }
+  // true if something was hit before ray.tfar
+  INLINE bool occluded(u32 id) const { return res[id].isec; }
+  // distance to the first hit (ray.tfar if none)
+  INLINE float dist(u32 id) const { return res[id].t; }
+  INLINE vec3f hitpoint(u32 id) const { return rays[id].org+rays[id].dir*dist(id); }
+  vector<ray> rays;
+  vector<isecres> res;
+};
 
 } // namespace world
 } // namespace cube